@@ -1,11 +1,90 @@
 #include "ss_yaml.hpp"
 
-#include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <cmath>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
+#ifdef _WIN32
 #include <Windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+// VS2013 has neither
+#define snprintf sprintf_s // same arguments
+#define noexcept throw()
+#endif
 
 using namespace std;
 
+// Every allocation of the program is counted so the benchmarks can report them. malloc and free
+// are not called right in the replaced operators, gcc would pair them with new expressions and
+// warn about a mismatch.
+static atomic<int64_t> g_allocs(0);
+static void* countedAlloc(size_t size) {
+    ++g_allocs;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+static void countedFree(void* p) {
+    free(p);
+}
+void* operator new(size_t size) {
+    return countedAlloc(size);
+}
+void* operator new[](size_t size) {
+    return countedAlloc(size);
+}
+void operator delete(void* p) noexcept {
+    countedFree(p);
+}
+void operator delete[](void* p) noexcept {
+    countedFree(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    countedFree(p);
+}
+void operator delete[](void* p, size_t) noexcept {
+    countedFree(p);
+}
+
+static double now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the most memory the process had resident so far, in bytes
+static size_t peakRss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return pmc.PeakWorkingSetSize;
+#else
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return (size_t)ru.ru_maxrss;
+#else
+    return (size_t)ru.ru_maxrss * 1024;
+#endif
+#endif
+}
+
 const char *test1 = R"**(
 version: 8
 str1: aaaaaa
@@ -34,28 +113,1157 @@ const char *test2 = "- bla";
 // tbd quotes
 
 
-int main()
+// compares my_strtod against the C library strtod bit for bit on random literals
+// of the shapes that matter: shortest round trip, short, long mantissas and tiny
+int testStrtod(int count)
+{
+    mt19937_64 rng(1234);
+    auto digits = [&](int n) {
+        string s;
+        for (int i = 0; i < n; ++i)
+            s += (char)('0' + rng() % 10);
+        return s;
+    };
+    int bad = 0, total = 0;
+    auto check = [&](const string& s) {
+        ++total;
+        char *e1, *e2;
+        double a = ss_yaml::my_strtod(s.c_str(), &e1);
+        double b = strtod(s.c_str(), &e2);
+        if (memcmp(&a, &b, sizeof(a)) != 0 || e1 != e2) {
+            if (bad++ < 10)
+                cout << "mismatch " << s << endl;
+        }
+    };
+    const char* fixed[] = { "0", "-0", "1e23", "9007199254740993", "4.9e-324", "2.4703282292062328e-324",
+        "2.2250738585072011e-308", "1.7976931348623157e308", "1.7976931348623159e308", "1e400", "1e-400",
+        "0.000000000000000000000000000000000000000000001", ".5", "5.", "1e", "-.5e+3" };
+    for (auto f : fixed)
+        check(f);
+
+    char buf[64];
+    for (int i = 0; i < count; ++i) {
+        uint64_t bits = rng();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        if (!isfinite(d))
+            continue;
+        switch (i % 6) {
+        case 0: snprintf(buf, sizeof(buf), "%.17g", d); check(buf); break;
+        case 1: snprintf(buf, sizeof(buf), "%.*g", 1 + (int)(rng() % 17), d); check(buf); break;
+        case 2: check(digits(1 + rng() % 25) + "." + digits(rng() % 25) + "e" + to_string((int)(rng() % 700) - 350)); break;
+        case 3: check(digits(1 + rng() % 8) + "." + digits(rng() % 8)); break;
+        case 4: { // a double written out past 17 digits, plus noise, needs the long mantissa path
+            snprintf(buf, sizeof(buf), "%.25e", d);
+            string lit = buf;
+            size_t e = lit.find('e');
+            check(lit.substr(0, e) + digits(rng() % 40) + lit.substr(e));
+            break;
+        }
+        default: check(digits(1 + rng() % 900) + "e-" + to_string(rng() % 400)); break;
+        }
+    }
+    cout << "strtod mismatches " << bad << " / " << total << endl;
+    return bad;
+}
+
+// throughput on coordinate like literals, the common case in our files
+void benchStrtod()
+{
+    mt19937 rng(1);
+    vector<string> lits;
+    char buf[64];
+    for (int i = 0; i < 1000000; ++i) {
+        snprintf(buf, sizeof(buf), "%.*f", 3 + i % 10, (rng() % 3600000) / 10000.0 - 180 + rng() / 4e12);
+        lits.push_back(buf);
+    }
+    for (int round = 0; round < 3; ++round) {
+        double sum1 = 0, sum2 = 0;
+        double start = now();
+        for (const auto& l : lits)
+            sum1 += ss_yaml::my_strtod(l.c_str(), nullptr);
+        double mid = now();
+        for (const auto& l : lits)
+            sum2 += strtod(l.c_str(), nullptr);
+        double end = now();
+        cout << "my_strtod " << (int)((mid - start) * 1000) << "ms strtod " << (int)((end - mid) * 1000) << "ms " << (sum1 == sum2 ? "" : "SUM DIFFERS") << endl;
+    }
+}
+
+// many threads reading one lazily parsed document with auto indexing at once, against the
+// answers read from a fully parsed copy on one thread. Meant to also run under a thread sanitizer
+int testThreads(int threads, int rounds)
+{
+    // the groups have different sizes and values, an index of the wrong list gives wrong answers
+    const int groups = 64;
+    vector<int> items(groups);
+    string text;
+    for (int g = 0; g < groups; ++g) {
+        items[g] = 50 + (g * 37) % 250;
+        text += "group_" + to_string(g) + ":\n";
+        for (int i = 0; i < items[g]; ++i)
+            text += "  - name: item_" + to_string(i) + "\n    value: " + to_string(g * 1000 + i * (g % 7 + 1)) + "\n    pos: [" + to_string(i) + ".5, " + to_string(g) + "]\n";
+    }
+    ss_yaml::Yaml plain;
+    plain.setAutoIndex(0);
+    plain.parse(text.c_str(), (int)text.size());
+    vector<vector<int>> expected(groups);
+    for (int g = 0; g < groups; ++g) {
+        auto list = plain.root()["group_" + to_string(g)];
+        for (int i = 0; i < items[g]; ++i)
+            expected[g].push_back(list.nodeWith("name", "item_" + to_string(i))["value"].i32());
+    }
+
+    int bad = 0;
+    for (int round = 0; round < rounds; ++round) {
+        ss_yaml::ParseOptions opt;
+        opt.lazy = true;
+        ss_yaml::Yaml shared;
+        shared.setAutoIndex(4);
+        shared.parse(text.c_str(), (int)text.size(), opt);
+        atomic<int> mismatches(0);
+        vector<thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.push_back(thread([&, t]() {
+                mt19937 rng(round * 1000 + t);
+                for (int n = 0; n < 20000; ++n) {
+                    int g = rng() % groups, i = rng() % items[g];
+                    auto list = shared.root()["group_" + to_string(g)];
+                    if (n % 1000 == t) // explicit builds racing with automatic ones
+                        list.buildIndex("name");
+                    auto e = list.nodeWith("name", "item_" + to_string(i));
+                    if (e["value"].i32() != expected[g][i] || e["pos"][0].dbl() != i + 0.5 || e["pos"][1].i32() != g)
+                        ++mismatches;
+                }
+            }));
+        }
+        for (auto& w : workers)
+            w.join();
+        bad += mismatches;
+    }
+    cout << "thread mismatches " << bad << endl;
+    return bad;
+}
+
+// nodeWith() by string, integer, 64 bit and double fields, by scanning and by an index
+int testIndex()
+{
+    string doc = "items:\n";
+    const char* rows[][4] = { { "123", "9000000000", "0.5", "a" }, { "7", "-9000000001", "1.25", "b" }, { "-4", "5", "2.5e3", "123x" } };
+    for (auto& r : rows)
+        doc += string("  - id: ") + r[0] + "\n    big: " + r[1] + "\n    ratio: " + r[2] + "\n    name: " + r[3] + "\n";
+    int bad = 0;
+    for (int indexed = 0; indexed < 2; ++indexed) {
+        ss_yaml::Yaml y;
+        y.setAutoIndex(0);
+        y.parse(doc.c_str(), (int)doc.size());
+        auto list = y.root()["items"];
+        if (indexed && !(list.buildIndex("id") && list.buildIndex("big") && list.buildIndex("ratio") && list.buildIndex("name")))
+            ++bad;
+        const char* finds[][3] = { // field, key, name of the element or "" for none
+            { "id", "123", "a" }, { "id", "7", "b" }, { "id", "-4", "123x" }, { "id", "0123", "a" }, { "id", "12", "" }, { "id", "123.0", "" },
+            { "big", "9000000000", "a" }, { "big", "-9000000001", "b" }, { "big", "5", "123x" },
+            { "ratio", "0.5", "a" }, { "ratio", "1.250", "b" }, { "ratio", "2500", "" }, { "ratio", "2.5e3", "123x" },
+            { "name", "b", "b" }, { "name", "123x", "123x" }, { "name", "123", "" },
+        };
+        for (auto& f : finds) {
+            auto e = list.tryNodeWith(f[0], f[1]);
+            string got = e.isNull() ? "" : e["name"].str();
+            if (got != f[2]) {
+                cout << (indexed ? "indexed " : "scanned ") << f[0] << " " << f[1] << ": got '" << got << "'" << endl;
+                ++bad;
+            }
+        }
+    }
+    cout << "index mismatches " << bad << endl;
+    return bad;
+}
+
+// the whole tree as text, to compare documents that were made in different ways
+string dumpTree(const ss_yaml::Accessor& a)
+{
+    char num[32];
+    const ss_yaml::Node* n = a.node;
+    switch (n->type) {
+    case ss_yaml::NODE_STR:
+        return "'" + a.str() + "'";
+    case ss_yaml::NODE_NUM_DBL:
+        snprintf(num, sizeof(num), "%.17g", a.dbl());
+        return num;
+    case ss_yaml::NODE_NUM_INT:
+    case ss_yaml::NODE_NUM_LONG:
+        return to_string(a.i64());
+    case ss_yaml::NODE_LIST: {
+        string r = "[";
+        for (int i = 0; i < a.len(); ++i)
+            r += (i ? "," : "") + dumpTree(a[i]);
+        return r + "]";
+    }
+    case ss_yaml::NODE_MAP: {
+        string r = "{";
+        const ss_yaml::Node* kv = n->children();
+        for (int i = 0; i < n->cont.count; ++i)
+            r += (i ? "," : "") + ss_yaml::Accessor(kv + i * 2, a.owner).str() + ":" + dumpTree(ss_yaml::Accessor(kv + i * 2 + 1, a.owner));
+        return r + "}";
+    }
+    default:
+        return "?";
+    }
+}
+
+// block and inline structure that the lazy parse and the structural index take other ways through
+const char* blockDocs[] = {
+    test1,
+    "a:\n- 1\n- 2\nb: 3\n",
+    "a:\nb: 2\n",
+    "a: [1,\n  2]\n# comment\n\nb:\n  c:\n    - x\n\n  d: y\ne: last",
+    "- 1\n-\n  - 2\n  - k: v\n- [a, [b, c], d]\n",
+    "-\n-\n- a\n",
+    "- a: 1\n  b: 2\n-\n  c: 3\n",
+    "a:\n  - 1\n",
+    "a:",
+    "a: [1,\n2, [3,\n4]]\nb: [5, 6]\nc: [\n7]",
+    "- [1,\n2]\n- [3]\n",
+    "a:\n  b:\nc: 1\n",
+    "- a:\n  b:\n- c\n",
+};
+
+// a lazy parse reads the same tree as a full one, for the shapes that decide where a value ends
+int testLazy()
+{
+    int bad = 0;
+    for (const char* doc : blockDocs) {
+        string expected, got;
+        ss_yaml::ParseOptions opt;
+        for (int lazy = 0; lazy < 2; ++lazy) {
+            opt.lazy = lazy != 0;
+            string& out = lazy ? got : expected;
+            try {
+                ss_yaml::Yaml y;
+                y.parse(doc, (int)strlen(doc), opt);
+                out = dumpTree(y.root());
+            }
+            catch (const exception& e) {
+                out = string("error ") + e.what();
+            }
+        }
+        if (got != expected) {
+            cout << "lazy: " << got << endl << "   expected " << expected << endl;
+            ++bad;
+        }
+    }
+    cout << "lazy mismatches " << bad << endl;
+    return bad;
+}
+
+// what a projected parse keeps of a document
+int testProject()
+{
+    struct Case {
+        const char* doc;
+        vector<string> paths;
+        const char* expected; // dumpTree() of the projection
+    };
+    const char* nested = "a:\n  b:\n    x: 1\n    y: 2\n  c:\n    x: 3\n    z: 4\n";
+    Case cases[] = {
+        { nested, { "a.*.x", "a.b.y" }, "{a:{b:{x:1,y:2},c:{x:3}}}" },
+        { nested, { "a.b.y", "a.*.x" }, "{a:{b:{x:1,y:2},c:{x:3}}}" },
+        { nested, { "*.*", "a.c.x" }, "{a:{b:{x:1,y:2},c:{x:3,z:4}}}" },
+        { nested, { "*.*.z", "a.b" }, "{a:{b:{x:1,y:2},c:{z:4}}}" },
+        { nested, { "a.c" }, "{a:{c:{x:3,z:4}}}" },
+        { nested, { "a.d" }, "{a:{}}" },
+        { nested, { "x" }, "{}" },
+        // skipped first, last and nested keys
+        { "skip: 1\nkeep: 2\n", { "keep" }, "{keep:2}" },
+        { "keep: 1\nskip:\n  a: [1, 2]\n", { "keep" }, "{keep:1}" },
+        { "id: 1\ndata:\n  h: 2\n  w: 3\n", { "data.h" }, "{data:{h:2}}" },
+        { "id: 1\ndata:\n  w:\n    deep: 1\n  h: [2,\n    3]\n  z: 4\n", { "data.h" }, "{data:{h:[2,3]}}" },
+        { "- name: a\n  data: 1\n- name: b\n- data: 3\n  name: c\n", { "[*].data" }, "[{data:1},{},{data:3}]" },
+        { "a:\n- 1\n- 2\nb: 3\n", { "b" }, "{b:3}" },
+        { "a: 1 # c\n\n# c\n  # c\nb: 2\n", { "b" }, "{b:2}" },
+        // inline lists that go on to lines that are not indented past their key
+        { "big: [1,\n  2]\nkeep: 1\n", { "keep" }, "{keep:1}" },
+        { "a:\n  big: [1,\n  2, [3,\n4]]\n  keep: 1\n", { "a.keep" }, "{a:{keep:1}}" },
+        { "a:\n  big: [1, '[', 2]\n  keep: 1\n", { "a.keep" }, "{a:{keep:1}}" },
+        // a skipped first key after a tag
+        { "- &t\n  skip: 1\n- x\n", { "[*].keep" }, "[{},'x']" },
+        { "a: &t\n  skip: 1\nb: 2\n", { "a.keep", "b" }, "{a:{},b:2}" },
+        // a missing value before a line that is not indented past its key
+        { "a:\n  b:\nc: 1\n", { "c" }, "{c:1}" },
+        { "a:\n  b:\nc: 1\n", { "a" }, "{a:{b:''}}" },
+        { "- a:\n  b:\n- c\n", { "[*].b" }, "[{b:''},'c']" },
+    };
+    int bad = 0;
+    for (const Case& c : cases) {
+        ss_yaml::Projection projection(c.paths);
+        ss_yaml::ParseOptions opt;
+        opt.projection = &projection;
+        string got;
+        try {
+            ss_yaml::Yaml y;
+            y.parse(c.doc, (int)strlen(c.doc), opt);
+            got = dumpTree(y.root());
+        }
+        catch (const exception& e) {
+            got = string("error ") + e.what();
+        }
+        if (got != c.expected) {
+            cout << "projection of " << c.paths[0] << "...: " << got << endl << "   expected " << c.expected << endl;
+            ++bad;
+        }
+    }
+    // a skipped key is not there at all
+    ss_yaml::Projection projection(vector<string>{ "data.h" });
+    ss_yaml::ParseOptions opt;
+    opt.projection = &projection;
+    ss_yaml::Yaml y;
+    string doc = "id: 1\ndata:\n  h: 2\n";
+    y.parse(doc.c_str(), (int)doc.size(), opt);
+    try {
+        y.root()["id"];
+        cout << "projection: a skipped key was found" << endl;
+        ++bad;
+    }
+    catch (const exception&) {
+    }
+    cout << "projection mismatches " << bad << endl;
+    return bad;
+}
+
+// the events of a parse as text
+struct RecordHandler : public ss_yaml::Handler
+{
+    string events;
+    void onMapStart() { events += "{"; }
+    void onKey(const ss_yaml::Str& s) { events += s.str() + ":"; }
+    void onScalar(const ss_yaml::Str& s) { events += "'" + s.str() + "',"; }
+    void onNumber(double d) { events += to_string(d) + ","; }
+    void onListStart(int) { events += "["; }
+    void onEnd() { events += "},"; }
+};
+
+// documents fed in chunks, with comments, numbers and errors
+const char* pushDocs[] = {
+    test1,
+    "a:\n  - [1, 2,\n     3]\n  - b: -4.5e1 # comment\n    c: x\n\n# last\nd: [ ]\n",
+    "- 1\n-\n  - 2\n  - k: v\n- [a, [b, c], d]",
+    "a: 1\nb: [1, 2\nc: 3\n",
+    "a:\n  b: 1\n c: 2\n",
+};
+
+// the push parser gives the events of a whole parse, and the same errors, for any chunk size
+int testPush()
+{
+    int bad = 0;
+    for (const char* doc : pushDocs) {
+        size_t size = strlen(doc);
+        string expected;
+        {
+            RecordHandler h;
+            try {
+                ss_yaml::EventParser().parse(doc, size, h);
+                expected = h.events;
+            }
+            catch (const exception& e) {
+                expected = string("error ") + e.what();
+            }
+        }
+        for (size_t chunk : { (size_t)1, (size_t)2, (size_t)3, (size_t)7, (size_t)64, size }) {
+            RecordHandler h;
+            string got;
+            try {
+                ss_yaml::PushParser p;
+                for (size_t i = 0; i < size; i += chunk)
+                    p.feed(doc + i, min(chunk, size - i), h);
+                p.finish(h);
+                got = h.events;
+            }
+            catch (const exception& e) {
+                got = string("error ") + e.what();
+            }
+            if (got != expected) {
+                cout << "chunks of " << chunk << ": " << got << endl << "   expected " << expected << endl;
+                ++bad;
+            }
+        }
+    }
+    cout << "push mismatches " << bad << endl;
+    return bad;
+}
+
+// the structural index gives the trees, and the errors, that the lexer gives
+int testStructIndex()
+{
+    vector<const char*> docs(begin(blockDocs), end(blockDocs));
+    docs.insert(docs.end(), begin(pushDocs), end(pushDocs));
+    int bad = 0;
+    for (const char* doc : docs) {
+        string expected, got;
+        ss_yaml::ParseOptions opt;
+        for (int indexed = 0; indexed < 2; ++indexed) {
+            opt.structIndex = indexed != 0;
+            string& out = indexed ? got : expected;
+            try {
+                ss_yaml::Yaml y;
+                y.parse(doc, (int)strlen(doc), opt);
+                out = dumpTree(y.root());
+            }
+            catch (const exception& e) {
+                out = string("error ") + e.what();
+            }
+        }
+        if (got != expected) {
+            cout << "struct index: " << got << endl << "   expected " << expected << endl;
+            ++bad;
+        }
+    }
+    cout << "struct index mismatches " << bad << endl;
+    return bad;
+}
+
+// lists of numbers read as matrices, arrays, spans and converted copies, and the shapes they refuse
+int testExtract()
 {
+    string text = "flat: [1, 2, 3, 4, 5, 6]\n"
+                  "nested: [[1, 2, 3], [4, 5.0, 6]]\n"
+                  "rows3: [[1, 2], [3, 4], [5, 6]]\n"
+                  "square: [[1, 2], [3, 4]]\n"
+                  "ragged: [[1, 2, 3], [4, 5]]\n"
+                  "five: [1, 2, 3, 4, 5]\n"
+                  "ints: [1, -2, 3]\n"
+                  "mixed: [1, 2.5]\n"
+                  "words: [1, a]\n";
+    for (int n = 0; n < 20; ++n) { // lengths around the 4 and 8 of the vector conversions
+        text += "dbl" + to_string(n) + ": [";
+        for (int i = 0; i < n; ++i)
+            text += (i ? ", " : "") + to_string(i) + ".1";
+        text += "]\n";
+    }
+    ss_yaml::Yaml y;
+    y.parse(text.c_str(), (int)text.size());
+    auto root = y.root();
+    int bad = 0;
+    auto check = [&](bool ok, const string& what) {
+        if (!ok) {
+            cout << "extract: " << what << endl;
+            ++bad;
+        }
+    };
+    auto fails = [&](const string& what, const function<void()>& f) {
+        try {
+            f();
+            check(false, what + " did not fail");
+        }
+        catch (const exception&) {
+        }
+    };
+
+    for (const char* key : { "flat", "nested" }) {
+        auto m = root[key].mat<double, 2, 3>();
+        check(m(0, 0) == 1 && m(0, 2) == 3 && m(1, 0) == 4 && m(1, 1) == 5 && m(1, 2) == 6, string("mat of ") + key);
+        auto a = root[key].as<array<int, 6>>();
+        check(a == array<int, 6>{ { 1, 2, 3, 4, 5, 6 } }, string("array of ") + key);
+    }
+    auto m32 = root["rows3"].mat<int, 3, 2>();
+    check(m32(2, 0) == 5 && m32(2, 1) == 6, "mat of 3 rows");
+    auto square = root["square"].mat<ss_yaml::Mat<float, 2, 2>, 2>();
+    check(square(0, 1) == 2 && square(1, 0) == 3, "square mat");
+    float rows[6];
+    root["rows3"].copyRowMajor(rows, 3, 2);
+    check(rows[0] == 1 && rows[3] == 4 && rows[5] == 6, "copyRowMajor of 3 rows");
+    fails("mat of 3 rows as 2", [&]() { root["rows3"].mat<double, 2, 3>(); });
+    fails("mat of ragged rows", [&]() { root["ragged"].mat<double, 2, 3>(); });
+    fails("mat of 5 numbers", [&]() { root["five"].mat<double, 2, 3>(); });
+    fails("array of 5 numbers", [&]() { root["five"].as<array<double, 6>>(); });
 
+    auto ints = root["ints"].asSpan<int64_t>();
+    check(ints.size == 3 && ints[1] == -2, "asSpan<int64_t>");
+    fails("asSpan<double> of integers", [&]() { root["ints"].asSpan<double>(); });
+    auto mixed = root["mixed"].asSpan<double>();
+    check(mixed.size == 2 && mixed[0] == 1 && mixed[1] == 2.5, "asSpan<double> of a mixed list");
+    fails("asSpan<int64_t> of a mixed list", [&]() { root["mixed"].asSpan<int64_t>(); });
+    fails("asSpan of words", [&]() { root["words"].asSpan<double>(); });
+    double fromInts[3];
+    root["ints"].copyTo(fromInts, 3);
+    check(fromInts[0] == 1 && fromInts[1] == -2 && fromInts[2] == 3, "copyTo of integers");
 
-    ifstream ifs("C:/projects/ss_yaml/test2.yml");
-    ifs.seekg(0, ios::end);
-    int sz = (int)ifs.tellg();
-    ifs.seekg(0, ios::beg);
-    vector<char> buf(sz+1);
-    ifs.read(&buf[0], sz);
-    buf[sz] = 0;
+    for (int n = 0; n < 20; ++n) {
+        auto list = root["dbl" + to_string(n)];
+        vector<float> f(n + 1, -1.0f);
+        list.copyTo(f.data(), n);
+        bool ok = f[n] == -1.0f; // nothing written past n
+        for (int i = 0; i < n; ++i)
+            ok = ok && f[i] == (float)(i + 0.1);
+        check(ok, "copyTo<float> of " + to_string(n));
+    }
+    cout << "extract mismatches " << bad << endl;
+    return bad;
+}
+
+struct TypedPart {
+    int id = 0;
+    double weight = 0;
+    bool on = false;
+};
+SS_YAML_BIND(TypedPart) { field("id", &TypedPart::id); field("weight", &TypedPart::weight); field("on", &TypedPart::on); }
+struct TypedDoc {
+    string name = "unset";
+    TypedPart main;
+    vector<TypedPart> parts;
+    array<int, 3> pos = { { 0, 0, 0 } };
+    float m[2][2] = { { 0, 0 }, { 0, 0 } };
+    int8_t small = 0;
+    uint16_t port = 0;
+    vector<vector<int>> grid;
+};
+SS_YAML_BIND(TypedDoc) {
+    field("name", &TypedDoc::name); field("main", &TypedDoc::main); field("parts", &TypedDoc::parts); field("pos", &TypedDoc::pos);
+    field("m", &TypedDoc::m); field("small", &TypedDoc::small); field("port", &TypedDoc::port); field("grid", &TypedDoc::grid);
+}
+
+// TypedParser reads nested structs, lists of them, fixed size lists and numbers in range, skips
+// keys that are not fields and throws with the line of a value that doesn't fit
+int testTyped()
+{
+    int bad = 0;
+    ss_yaml::TypedParser parser;
+    auto parse = [&](const string& text, TypedDoc& out) {
+        try {
+            parser.parse(text.c_str(), text.size(), out);
+            return string();
+        }
+        catch (const exception& e) {
+            return string(e.what());
+        }
+    };
 
-    auto start = GetTickCount();
-    for (int i = 0; i < 10; ++i) {
+    TypedDoc d;
+    string err = parse("name: full\n"
+                       "extra:\n  deep: [1, [2, 3]]\n  more:\n    - x\n"
+                       "main:\n  id: 7\n  weight: 2.5\n  on: true\n  unknown: 1\n"
+                       "parts:\n  - id: 1\n  - id: 2\n    on: false\n    weight: -3\n"
+                       "pos: [1, -2, 3]\n"
+                       "m: [[1, 2], [3.5, 4]]\n"
+                       "small: -128\n"
+                       "port: 65535\n"
+                       "grid:\n  - [1]\n  - []\n  - [2, 3]\n", d);
+    bool ok = err.empty() && d.name == "full" && d.main.id == 7 && d.main.weight == 2.5 && d.main.on && d.parts.size() == 2 &&
+              d.parts[0].id == 1 && !d.parts[0].on && d.parts[1].id == 2 && d.parts[1].weight == -3 && d.pos == array<int, 3>{ { 1, -2, 3 } } &&
+              d.m[1][0] == 3.5f && d.m[1][1] == 4 && d.small == -128 && d.port == 65535 && d.grid.size() == 3 && d.grid[1].empty() && d.grid[2][1] == 3;
+    if (!ok) {
+        cout << "typed: full document " << err << endl;
+        ++bad;
+    }
+
+    // fields that are not in the document keep their value, lists are replaced
+    TypedDoc kept;
+    kept.parts.resize(3);
+    err = parse("main:\n  weight: 1\nparts: []\n", kept);
+    if (!err.empty() || kept.name != "unset" || kept.main.weight != 1 || !kept.parts.empty()) {
+        cout << "typed: kept values " << err << endl;
+        ++bad;
+    }
+
+    struct Case {
+        const char* doc;
+        const char* error; // the start of the message
+    };
+    Case errors[] = {
+        { "small: 128\n", "line 1: '128' where an integer was expected" },
+        { "name: a\nport: -1\n", "line 2: '-1' where an integer was expected" },
+        { "port: 65536\n", "line 1: '65536' where an integer was expected" },
+        { "main:\n  id: 1.5\n", "line 2: '1.5' where an integer was expected" },
+        { "main:\n  on: yes\n", "line 2: 'yes' where true or false was expected" },
+        { "pos: [1, 2]\n", "line 1: wrong number of elements for a list of a fixed size" },
+        { "pos: [1, 2, 3, 4]\n", "line 1: too many elements for a list of a fixed size" },
+        { "m: [1, 2]\n", "line 1: '1' where a list of a fixed size was expected" },
+        { "parts: x\n", "line 1: 'x' where a list was expected" },
+        { "main: [1]\n", "line 1: a list where a map was expected" },
+        { "- 1\n", "line 1: a list where a map was expected" },
+    };
+    for (const Case& c : errors) {
+        TypedDoc out;
+        err = parse(c.doc, out);
+        if (err.compare(0, strlen(c.error), c.error) != 0) {
+            cout << "typed: " << c.doc << "got '" << err << "'" << endl << "   expected '" << c.error << "'" << endl;
+            ++bad;
+        }
+    }
+    cout << "typed mismatches " << bad << endl;
+    return bad;
+}
+
+// a snapshot loads as the document it was saved from, and images it can't use are refused
+int testSnapshot()
+{
+    string text = test1;
+    for (int i = 0; i < 100; ++i)
+        text += "item_" + to_string(i) + ":\n  name: n" + to_string(i) + "\n  pos: [" + to_string(i) + ".5, -" + to_string(i) + "]\n";
+    ss_yaml::Yaml doc;
+    doc.parse(text.c_str(), (int)text.size());
+    string expected = dumpTree(doc.root());
+    uint64_t hash = ss_yaml::hash64(text.c_str(), text.size());
+
+    int bad = 0;
+    vector<char> image;
+    doc.saveSnapshot(image);
+    ss_yaml::Yaml loaded;
+    if (!loaded.loadSnapshot(image.data(), image.size(), hash) || dumpTree(loaded.root()) != expected)
+        ++bad;
+    if (loaded.loadSnapshot(image.data(), image.size(), hash + 1)) // made from another text
+        ++bad;
+    if (loaded.loadSnapshot(image.data(), image.size() - 1))
+        ++bad;
+    vector<char> other = image;
+    other[offsetof(ss_yaml::SnapshotHeader, nodeCount)] ^= 1;
+    if (loaded.loadSnapshot(other.data(), other.size()))
+        ++bad;
+    other = image;
+    other[0] = 'x';
+    if (loaded.loadSnapshot(other.data(), other.size()))
+        ++bad;
+
+    // parseFileCached writes a snapshot, uses it while the yaml is the same and not after it changed
+    const char* yamlPath = "snapshot-test.yaml";
+    const char* snapshotPath = "snapshot-test.snapshot";
+    ofstream(yamlPath, ios::binary) << text;
+    remove(snapshotPath);
+    for (int round = 0; round < 3; ++round) {
+        if (round == 2) {
+            text += "added: 1\n";
+            ofstream(yamlPath, ios::binary) << text;
+            doc.parse(text.c_str(), (int)text.size());
+            expected = dumpTree(doc.root());
+        }
+        ss_yaml::Yaml cached;
+        cached.parseFileCached(yamlPath, snapshotPath);
+        if (dumpTree(cached.root()) != expected) {
+            cout << "parseFileCached round " << round << " read the wrong document" << endl;
+            ++bad;
+        }
+        if (!ifstream(snapshotPath).good())
+            ++bad;
+    }
+    remove(yamlPath);
+    remove(snapshotPath);
+    cout << "snapshot mismatches " << bad << endl;
+    return bad;
+}
+
+// the cache hits on the same text from any buffer and drops the least recently used over the budget
+int testCache()
+{
+    vector<string> texts;
+    for (int t = 0; t < 3; ++t) {
+        string text;
+        for (int i = 0; i < 200; ++i)
+            text += "doc" + to_string(t) + "_" + to_string(i) + ": [" + to_string(i) + ", " + to_string(t) + "]\n";
+        texts.push_back(text);
+    }
+    size_t entryBytes;
+    {
+        ss_yaml::ParseCache probe(1 << 30);
+        probe.parse(texts[0]);
+        entryBytes = probe.stats().bytes;
+    }
+    int bad = 0;
+    auto expect = [&](bool ok, const char* what) {
+        if (!ok) {
+            cout << "cache: " << what << endl;
+            ++bad;
+        }
+    };
+    ss_yaml::ParseCache cache(entryBytes * 5 / 2); // room for two
+    auto a = cache.parse(texts[0]);
+    auto b = cache.parse(texts[1]);
+    string copy = texts[0];
+    expect(cache.parse(copy) == a, "same text in another buffer is a hit");
+    cache.parse(texts[2]); // b is the least recently used
+    auto st = cache.stats();
+    expect(st.hits == 1 && st.misses == 3 && st.evictions == 1 && st.entries == 2, "counts after an eviction");
+    expect(cache.parse(texts[0]) == a, "a stays");
+    expect((*b).root()["doc1_199"][1].i32() == 1, "an evicted document stays alive while held");
+    expect(cache.parse(texts[1]) != b, "b was evicted");
+    st = cache.stats();
+    expect(st.entries == 2 && st.bytes <= entryBytes * 5 / 2, "stays in the budget");
+
+    ss_yaml::Projection first(vector<string>{ "doc2_0" });
+    ss_yaml::ParseOptions opt;
+    opt.projection = &first;
+    auto projected = cache.parse(texts[2], opt);
+    expect(projected->root().len() == 1 && cache.parse(texts[2])->root().len() == 200, "a projection is not cached for a full parse");
+    expect(cache.parse(texts[2], opt)->root().len() == 1, "a full parse is not given for a projection");
+
+    ss_yaml::ParseCache tiny(1);
+    auto big = tiny.parse(texts[0]);
+    expect(big->root()["doc0_0"][0].i32() == 0 && tiny.stats().entries == 0, "a document over the budget is given out but not kept");
+    cout << "cache mismatches " << bad << endl;
+    return bad;
+}
+
+// Documents big enough to be parsed in pieces on threads give the same tree, or the same error,
+// as a sequential parse. The pieces are cut at top level entries, these are the shapes around cuts.
+int testStitch(int threads)
+{
+    auto big = [](const function<string(int)>& entry, const string& tail) {
+        string text;
+        for (int i = 0; text.size() < 2 * 1024 * 1024; ++i)
+            text += entry(i);
+        return text + tail;
+    };
+    struct Case {
+        const char* name;
+        string text;
+    };
+    vector<Case> cases = {
+        { "map", big([](int i) { return "key_" + to_string(i) + ":\n  a: " + to_string(i) + "\n  l:\n    - x\n    - [1, 2.5]\n"; }, "") },
+        { "map no newline", big([](int i) { return "key_" + to_string(i) + ": " + to_string(i) + "\n"; }, "last: 1") },
+        { "map comments", big([](int i) { return "# entry\nkey_" + to_string(i) + ":\n\n  v: [a,\n    b]\n\n"; }, "# end\n") },
+        { "map same column lists", big([](int i) { return "key_" + to_string(i) + ":\n- " + to_string(i) + "\n- k: v\n"; }, "") },
+        { "list of maps", big([](int i) { return "- name: n" + to_string(i) + "\n  v: " + to_string(i) + ".25\n"; }, "") },
+        { "list of lists", big([](int i) { return "-\n  - " + to_string(i) + "\n  -\n    - x\n"; }, "- last") },
+        { "error", big([](int i) { return i == 30000 ? string("key_x: [1\n") : "key_" + to_string(i) + ": " + to_string(i) + "\n"; }, "") },
+    };
+    int bad = 0;
+    for (const Case& c : cases) {
+        string expected, got;
+        ss_yaml::ParseOptions opt;
+        for (int t : { 1, threads }) {
+            opt.threads = t;
+            string& out = (t == 1) ? expected : got;
+            try {
+                ss_yaml::Yaml doc;
+                doc.parse(c.text.c_str(), (int)c.text.size(), opt);
+                out = dumpTree(doc.root());
+            }
+            catch (const exception& e) {
+                out = string("error ") + e.what();
+            }
+        }
+        if (got != expected) {
+            cout << c.name << ": " << got.substr(0, 200) << endl << "   expected " << expected.substr(0, 200) << endl;
+            ++bad;
+        }
+    }
+    cout << "stitch mismatches " << bad << endl;
+    return bad;
+}
+
+
+// A synthetic document for the benchmark with what to do with it once parsed. The generators are
+// seeded so every run measures the same text. `nodes` is how many the tape has, a map entry is two.
+struct BenchDoc {
+    string name;
+    string text;
+    int64_t nodes = 0;
+    // read things from the document, return how many
+    function<int64_t(ss_yaml::Accessor)> lookup;
+    function<int64_t(ss_yaml::Accessor)> extract;
+    function<int64_t(ss_yaml::Accessor)> query; // what extract reads, through compiled paths. optional
+    function<int64_t(const string&)> bind;      // what extract reads, straight from the text. optional
+    function<int64_t(const string&)> project;   // parses only a few parts of the text and reads them. optional
+};
+
+// trees of maps nested `depth` deep, with a number at the bottom
+BenchDoc genDeep(double scale)
+{
+    BenchDoc d;
+    d.name = "deep";
+    const int depth = 48, trees = max(1, (int)(2000 * scale));
+    mt19937 rng(1);
+    int64_t total = 0, someTotal = 0;
+    auto paths = make_shared<vector<ss_yaml::Path>>();
+    auto some = make_shared<ss_yaml::Projection>(); // every 50th tree
+    for (int t = 0; t < trees; ++t) {
+        d.text += "tree_" + to_string(t) + ":\n";
+        d.nodes += 2;
+        string path = "tree_" + to_string(t);
+        for (int i = 0; i < depth; ++i) {
+            int leaf = rng() % 100000;
+            d.text += string(2 * (i + 1), ' ') + "k" + to_string(i) + ":" + (i + 1 < depth ? "\n" : " " + to_string(leaf) + "\n");
+            d.nodes += 2;
+            path += ".k" + to_string(i);
+            if (i + 1 == depth) {
+                total += leaf;
+                someTotal += (t % 50 == 0) ? leaf : 0;
+            }
+        }
+        paths->push_back(ss_yaml::Path(path));
+        if (t % 50 == 0)
+            some->add(path);
+    }
+    ++d.nodes; // root
+    d.lookup = [=](ss_yaml::Accessor root) {
+        int64_t n = 0;
+        for (int t = 0; t < trees; ++t) {
+            auto a = root["tree_" + to_string(t)];
+            for (int i = 0; i < depth; ++i, ++n)
+                a = a["k" + to_string(i)];
+        }
+        return n;
+    };
+    d.extract = [=](ss_yaml::Accessor root) {
+        int64_t sum = 0;
+        for (int t = 0; t < trees; ++t) {
+            auto a = root["tree_" + to_string(t)];
+            for (int i = 0; i < depth; ++i)
+                a = a["k" + to_string(i)];
+            sum += a.i32();
+        }
+        return sum == 0 ? 0 : (int64_t)trees;
+    };
+    d.query = [=](ss_yaml::Accessor root) {
+        int64_t sum = 0;
+        for (const auto& p : *paths)
+            sum += p.first(root).i32();
+        if (sum != total)
+            throw runtime_error("deep: path query read the wrong values");
+        return (int64_t)trees;
+    };
+    d.project = [=](const string& text) {
+        ss_yaml::ParseOptions opt;
+        opt.projection = some.get();
         ss_yaml::Yaml doc;
-        doc.parse(&buf[0]);
+        doc.parse(text.c_str(), (int)text.size(), opt);
+        int64_t sum = 0;
+        for (int t = 0; t < trees; t += 50)
+            sum += (*paths)[t].first(doc.root()).i32();
+        if (sum != someTotal)
+            throw runtime_error("deep: projection read the wrong values");
+        return (int64_t)(trees + 49) / 50;
+    };
+    return d;
+}
+
+// maps with many entries each
+BenchDoc genWide(double scale)
+{
+    BenchDoc d;
+    d.name = "wide";
+    const int maps = max(1, (int)(200 * scale)), fields = 1000;
+    mt19937 rng(2);
+    int64_t total = 0;
+    for (int m = 0; m < maps; ++m) {
+        d.text += "map_" + to_string(m) + ":\n";
+        for (int f = 0; f < fields; ++f) {
+            int v = rng() % 1000000;
+            d.text += "  field_" + to_string(f) + ": " + to_string(v) + "\n";
+            total += v;
+        }
+        d.nodes += 2 + fields * 2;
     }
-    auto elapsed = GetTickCount() - start;
-    cout << "done " << elapsed << endl;
+    // a field of every map
+    auto paths = make_shared<vector<ss_yaml::Path>>();
+    for (int f = 0; f < fields; ++f)
+        paths->push_back(ss_yaml::Path("*.field_" + to_string(f)));
+    ++d.nodes;
+    d.lookup = [=](ss_yaml::Accessor root) {
+        mt19937 r(3);
+        int64_t n = 0;
+        for (int m = 0; m < maps; ++m) {
+            auto a = root["map_" + to_string(m)];
+            for (int i = 0; i < 200; ++i, ++n)
+                a["field_" + to_string(r() % fields)];
+        }
+        return n;
+    };
+    d.extract = [=](ss_yaml::Accessor root) {
+        int64_t n = 0, sum = 0;
+        char key[32];
+        for (int m = 0; m < maps; ++m) {
+            auto a = root["map_" + to_string(m)];
+            for (int f = 0; f < fields; ++f, ++n) {
+                snprintf(key, sizeof(key), "field_%d", f);
+                sum += a[key].i32();
+            }
+        }
+        return sum == 0 ? 0 : n;
+    };
+    d.query = [=](ss_yaml::Accessor root) {
+        vector<int> out(maps);
+        int64_t n = 0, sum = 0;
+        for (const auto& p : *paths) {
+            int found = p.read(root, out.data(), maps);
+            for (int i = 0; i < found; ++i)
+                sum += out[i];
+            n += found;
+        }
+        if (sum != total)
+            throw runtime_error("wide: path query read the wrong values");
+        return n;
+    };
+    return d;
+}
 
-    //auto s = doc.root()["objects"][1]["data"]["model_data"]["height"].dbl();
+// long flow lists of numbers, like the coordinates of a mesh
+BenchDoc genNumbers(double scale)
+{
+    BenchDoc d;
+    d.name = "numbers";
+    const int lists = max(1, (int)(500 * scale)), len = 2000;
+    mt19937 rng(4);
+    char buf[64];
+    for (int l = 0; l < lists; ++l) {
+        d.text += "series_" + to_string(l) + ": [";
+        for (int i = 0; i < len; ++i) {
+            if (i % 4 == 3)
+                snprintf(buf, sizeof(buf), "%d", (int)(rng() % 1000));
+            else
+                snprintf(buf, sizeof(buf), "%.6f", (rng() % 2000000) / 1000.0 - 1000);
+            d.text += buf;
+            d.text += (i + 1 < len) ? ", " : "]\n";
+        }
+        d.nodes += 2 + len;
+    }
+    ++d.nodes;
+    d.lookup = [=](ss_yaml::Accessor root) {
+        mt19937 r(5);
+        int64_t n = 0;
+        for (int l = 0; l < lists; ++l) {
+            auto a = root["series_" + to_string(l)];
+            for (int i = 0; i < 200; ++i, ++n)
+                a[r() % len].dbl();
+        }
+        return n;
+    };
+    d.extract = [=](ss_yaml::Accessor root) {
+        vector<double> out(len);
+        int64_t n = 0;
+        for (int l = 0; l < lists; ++l, n += len)
+            root["series_" + to_string(l)].copyTo(out.data(), len);
+        return n;
+    };
+    auto last = make_shared<ss_yaml::Projection>(vector<string>{ "series_" + to_string(lists - 1) });
+    d.project = [=](const string& text) {
+        ss_yaml::ParseOptions opt;
+        opt.projection = last.get();
+        ss_yaml::Yaml doc;
+        doc.parse(text.c_str(), (int)text.size(), opt);
+        vector<double> out(len);
+        doc.root()["series_" + to_string(lists - 1)].copyTo(out.data(), len);
+        return (int64_t)len;
+    };
+    return d;
+}
 
+struct BenchRecord {
+    string name, owner, text;
+};
+SS_YAML_BIND(BenchRecord) { field("name", &BenchRecord::name); field("owner", &BenchRecord::owner); field("text", &BenchRecord::text); }
+struct BenchRecords {
+    vector<BenchRecord> records;
+};
+SS_YAML_BIND(BenchRecords) { field("records", &BenchRecords::records); }
 
+// a list of records that are mostly text, long words since a plain scalar can't have spaces
+BenchDoc genStrings(double scale)
+{
+    BenchDoc d;
+    d.name = "strings";
+    const int records = max(1, (int)(50000 * scale));
+    mt19937 rng(6);
+    auto word = [&]() {
+        string w;
+        for (int n = 3 + rng() % 8; n > 0; --n)
+            w += (char)('a' + rng() % 26);
+        return w;
+    };
+    d.text = "records:\n";
+    for (int r = 0; r < records; ++r) {
+        d.text += "  - name: rec_" + to_string(r) + "\n    owner: " + word() + "\n    text: ";
+        for (int n = 8 + rng() % 16; n > 0; --n)
+            d.text += word() + (n > 1 ? "_" : "\n");
+        d.nodes += 1 + 3 * 2;
+    }
+    d.nodes += 3;
+    d.lookup = [=](ss_yaml::Accessor root) {
+        mt19937 r(7);
+        auto list = root["records"];
+        int64_t n = 0;
+        for (int i = 0; i < 20000; ++i, ++n)
+            list.nodeWith("name", "rec_" + to_string(r() % records));
+        return n;
+    };
+    d.extract = [=](ss_yaml::Accessor root) {
+        auto list = root["records"];
+        size_t total = 0;
+        for (int r = 0; r < records; ++r)
+            total += list[r]["text"].str().size() + list[r]["owner"].str().size();
+        return total == 0 ? 0 : (int64_t)records * 2;
+    };
+    auto parser = make_shared<ss_yaml::TypedParser>();
+    d.bind = [=](const string& text) {
+        BenchRecords out;
+        parser->parse(text.c_str(), text.size(), out);
+        if ((int)out.records.size() != records || out.records.back().name != "rec_" + to_string(records - 1))
+            throw runtime_error("strings: bound the wrong records");
+        return (int64_t)records * 2;
+    };
+    return d;
+}
+
+// mean and standard deviation of the seconds `f` takes, over `reps` runs after one to warm up.
+// allocs is the average number of allocations of a run
+struct Timing {
+    double mean = 0, dev = 0;
+    double allocs = 0;
+};
+Timing timeRuns(int reps, const function<void()>& f)
+{
+    f();
+    vector<double> times;
+    times.reserve(reps);
+    int64_t allocs = g_allocs;
+    for (int i = 0; i < reps; ++i) {
+        double start = now();
+        f();
+        times.push_back(now() - start);
+    }
+    Timing t;
+    t.allocs = (double)(g_allocs - allocs) / reps;
+    for (double x : times)
+        t.mean += x / reps;
+    for (double x : times)
+        t.dev += (x - t.mean) * (x - t.mean) / reps;
+    t.dev = sqrt(t.dev);
+    return t;
+}
+
+void report(const string& doc, const char* phase, const Timing& t, const string& rate)
+{
+    char line[256];
+    snprintf(line, sizeof(line), "%-8s %-8s %9.3f ms +-%5.1f%%  %s  allocs %.0f  peak rss %.1f MB",
+             doc.c_str(), phase, t.mean * 1000, t.mean > 0 ? t.dev / t.mean * 100 : 0.0, rate.c_str(), t.allocs, peakRss() / 1048576.0);
+    cout << line << endl;
+}
+
+string perSec(double count, double seconds, const char* unit)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%9.2f %s/s", seconds > 0 ? count / seconds / 1e6 : 0.0, unit);
+    return buf;
+}
+
+// parses the document in a new Yaml every run, then times the reading on one parsed copy
+void benchDoc(const BenchDoc& d, int reps)
+{
+    Timing parse = timeRuns(reps, [&]() {
+        ss_yaml::Yaml doc;
+        doc.parse(d.text.c_str(), (int)d.text.size());
+    });
+    report(d.name, "parse", parse, perSec((double)d.text.size(), parse.mean, "MB") + perSec((double)d.nodes, parse.mean, "Mnodes"));
+    ss_yaml::Yaml doc;
+    doc.parse(d.text.c_str(), (int)d.text.size());
+    int64_t count = 0;
+    Timing lookup = timeRuns(reps, [&]() { count = d.lookup(doc.root()); });
+    report(d.name, "lookup", lookup, perSec((double)count, lookup.mean, "Mlookups"));
+    Timing extract = timeRuns(reps, [&]() { count = d.extract(doc.root()); });
+    report(d.name, "extract", extract, perSec((double)count, extract.mean, "Mvalues"));
+    if (count == 0)
+        cout << d.name << ": extracted nothing" << endl;
+    if (d.bind) {
+        Timing bind = timeRuns(reps, [&]() { count = d.bind(d.text); });
+        report(d.name, "bind", bind, perSec((double)d.text.size(), bind.mean, "MB") + perSec((double)count, bind.mean, "Mvalues"));
+    }
+    if (d.query) {
+        Timing query = timeRuns(reps, [&]() { count = d.query(doc.root()); });
+        report(d.name, "path", query, perSec((double)count, query.mean, "Mvalues"));
+    }
+    if (d.project) {
+        Timing project = timeRuns(reps, [&]() { count = d.project(d.text); });
+        report(d.name, "project", project, perSec((double)d.text.size(), project.mean, "MB") + perSec((double)count, project.mean, "Mvalues"));
+    }
+}
+
+// `scale` shrinks or grows the documents, 1 is tens of MB in all
+int bench(int reps, double scale)
+{
+    BenchDoc (*gens[])(double) = { genDeep, genWide, genNumbers, genStrings };
+    for (auto gen : gens) {
+        BenchDoc d = gen(scale);
+        cout << d.name << ": " << d.text.size() / 1024 << " KB, " << d.nodes << " nodes" << endl;
+        benchDoc(d, reps);
+    }
     return 0;
+}
+
+#ifdef SS_YAML_STATS
+void printStats(const ss_yaml::ParseStats& s)
+{
+    static const char* types[] = { "none", "map", "list", "double", "long", "int", "string", "lazy" };
+    cout << "bytes " << s.bytes << ", depth " << s.maxDepth << ", arena " << s.arenaBytes << " bytes" << endl;
+    cout << "nodes:";
+    for (int i = 0; i <= ss_yaml::NODE_LAZY; ++i)
+        cout << " " << types[i] << " " << s.nodes[i];
+    cout << endl << "my_strtod " << s.strtodCalls << " calls, " << s.strtodSeconds * 1000 << " ms" << endl;
+    cout << "list size hint hits " << s.listHintHits << " misses " << s.listHintMisses << endl;
+    const uint64_t* sizes[] = { s.listSizes, s.mapSizes };
+    for (int k = 0; k < 2; ++k) {
+        cout << (k == 0 ? "list sizes:" : "map sizes:");
+        for (int b = 0; b < ss_yaml::ParseStats::SIZE_BUCKETS; ++b) {
+            if (sizes[k][b] != 0 && b == ss_yaml::ParseStats::SIZE_BUCKETS - 1)
+                cout << " >=" << (1 << (b - 1)) << ":" << sizes[k][b];
+            else if (sizes[k][b] != 0)
+                cout << " <" << (1 << b) << ":" << sizes[k][b];
+        }
+        cout << endl;
+    }
+}
+#endif
+
+// times parsing a file the way the program used to
+int benchFile(const char* path, int reps)
+{
+    Timing t = timeRuns(reps, [&]() {
+        ss_yaml::Yaml doc;
+        doc.parseFile(path);
+    });
+    ifstream f(path, ios::binary | ios::ate);
+    report(path, "parse", t, perSec((double)f.tellg(), t.mean, "MB"));
+#ifdef SS_YAML_STATS
+    ss_yaml::Yaml doc;
+    doc.parseFile(path);
+    printStats(doc.stats());
+#endif
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    string mode = argc > 1 ? argv[1] : "";
+    if (mode == "strtod-test")
+        return testStrtod(argc > 2 ? atoi(argv[2]) : 1000000) != 0;
+    if (mode == "thread-test")
+        return testThreads(argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? atoi(argv[3]) : 10) != 0;
+    if (mode == "index-test")
+        return testIndex() != 0;
+    if (mode == "lazy-test")
+        return testLazy() != 0;
+    if (mode == "project-test")
+        return testProject() != 0;
+    if (mode == "push-test")
+        return testPush() != 0;
+    if (mode == "structindex-test")
+        return testStructIndex() != 0;
+    if (mode == "extract-test")
+        return testExtract() != 0;
+    if (mode == "typed-test")
+        return testTyped() != 0;
+    if (mode == "snapshot-test")
+        return testSnapshot() != 0;
+    if (mode == "cache-test")
+        return testCache() != 0;
+    if (mode == "stitch-test")
+        return testStitch(argc > 2 ? atoi(argv[2]) : 4) != 0;
+    if (mode == "strtod-bench") {
+        benchStrtod();
+        return 0;
+    }
+    if (mode == "parse-file" && argc > 2)
+        return benchFile(argv[2], argc > 3 ? atoi(argv[3]) : 10);
+    if (mode == "bench" || mode.empty())
+        return bench(argc > 2 ? atoi(argv[2]) : 10, argc > 3 ? atof(argv[3]) : 1.0);
+
+    cout << "usage: tester [bench [reps [scale]] | parse-file <path> [reps] | strtod-test [count] | strtod-bench | thread-test [threads [rounds]] | index-test | lazy-test | project-test | push-test | structindex-test | extract-test | typed-test | snapshot-test | cache-test | stitch-test [threads]]" << endl;
+    return 1;
 }
\ No newline at end of file
@@ -1,423 +1,3700 @@
-#pragma once
-
-#include <map>
-#include <vector>
-#include <string>
-#include <memory>
-
-namespace ss_yaml {
-using namespace std;
-
-
-
-
-#define CHECK(cond) do { if (!(cond)) throw std::runtime_error("failed CHECK(" #cond ")"); } while(false)
-#define FAIL(text) do { throw std::runtime_error(text); } while(false)
-
-extern "C" double my_strtod(const char *string, char **endPtr);
-
-struct Str {
-    Str(const char* s, int sz) : start(s), size(sz) {}
-    explicit Str(const char* s) : start(s), size((int)strlen(s)) {}
-    explicit Str(const string& s) : start(s.data()), size((int)s.size()) {}
-    const char* end() { return start + size; } // one after the last character
-
-    const char* start;
-    int size;
-};
-bool operator==(const Str& a, const Str& b) {
-    return a.size == b.size && memcmp(a.start, b.start, a.size) == 0;
-}
-template<typename T>
-bool operator==(const Str& a, const T& b) {
-    return operator==(a, Str(b));
-}
-bool operator<(const Str& a, const Str& b) {
-    if (a.size != b.size)
-        return a.size < b.size;
-    return memcmp(a.start, b.start, a.size) < 0;
-}
-
-
-enum ENodeType {
-    NODE_NONE = 0,
-    NODE_MAP = 1,
-    NODE_LIST,
-    NODE_NUM_DBL,
-    NODE_NUM_LONG,
-    NODE_NUM_INT,
-    NODE_STR,
-};
-
-struct Node {
-    unsigned char type;  // ENodeType
-};
-
-struct DataNode : public Node {
-    union {
-        struct {
-            int pos;
-            int size;
-        } str;
-        double num_dbl;
-        int64_t num_long;
-        int num_int;
-    };
-};
-
-struct MapNode : public Node {
-    map<Str, Node*> v;
-};
-struct ListNode : public Node {
-    vector<Node*> v;
-};
-
-
-class Yaml;
-
-struct Accessor
-{
-    Node* node;
-    Yaml* owner;
-
-    Accessor(Node* _node, Yaml* _owner) : node(_node), owner(_owner) {}
-    virtual ~Accessor() {}
-    virtual Accessor operator[](int index) { return getOp(node->type).op_sq_int(this, index); }  //FAIL("operator[int] not implemented for this node"); }
-    virtual Accessor operator[](const string& key) { return getOp(node->type).op_sq_str(this, key); } //FAIL("operator[str] not implemented for this node"); }
-    virtual Accessor operator[](const char* key) { return getOp(node->type).op_sq_chp(this, key); } //FAIL("operator[char*] not implemented for this node"); }
-    virtual Accessor nodeWith(const string& name, const string& key) { return getOp(node->type).nodeWith(this, name, key); } //FAIL("nodeWith not implemented for this node"); }
-    virtual Accessor tryNodeWith(const string& name, const string& key) { return getOp(node->type).tryNodeWith(this, name, key); } // FAIL("tryNodeWith not implemented for this node");
-
-    virtual string str() { return getOp(node->type).str(this); } // FAIL("str not implemented for this node"); }
-    virtual double dbl() { return getOp(node->type).dbl(this); } // FAIL("flt not implemented for this node"); }
-    virtual int len() { return getOp(node->type).len(this); } //FAIL("len not implemented for this node"); }
-
-    bool isNull() const { return node == nullptr; }
-
-    template<typename MatT, int sz>
-    MatT mat()
-    {
-        CHECK(this->len() == sz);
-        MatT ret;
-        for (int i = 0; i < sz; ++i) {
-            Node& line = (*this)[i];
-            CHECK(line.len() == sz);
-            for (int j = 0; j < sz; ++j)
-                ret(i, j) = line[j].dbl();
-        }
-        return ret;
-    }
-
-
-    // ---------------
-    static Accessor map_sq_str(Accessor* that, const string& key) {
-        auto& v = ((MapNode*)that->node)->v;
-        auto it = v.find(Str(key));
-        CHECK(it != v.end());
-        return Accessor(it->second, that->owner);
-    }
-    static Accessor map_sq_chp(Accessor* that, const char* key) {
-        auto& v = ((MapNode*)that->node)->v;
-        auto it = v.find(Str(key));
-        CHECK(it != v.end());
-        return Accessor(it->second, that->owner);
-    }
-    static int map_len(Accessor* that) {
-        auto& v = ((MapNode*)that->node)->v;
-        return (int)v.size();
-    }
-    
-    // -------------
-    static Accessor list_sq_int(Accessor* that, int index) {
-        auto& v = ((ListNode*)that->node)->v;
-        return Accessor(v[index], that->owner);
-    }
-    static int list_len(Accessor* that) {
-        auto& v = ((ListNode*)that->node)->v;
-        return (int)v.size();
-    }
-    static Accessor list_nodeWith(Accessor* that, const string& name, const string& key) {
-        auto& v = ((ListNode*)that->node)->v;
-        for (auto it = v.begin(); it != v.end(); ++it) {
-            Accessor a(*it, that->owner);
-            if (a[name].str() == key)
-                return a;
-        }
-        FAIL("id not found");
-    }
-    static Accessor list_tryNodeWith(Accessor* that, const string& name, const string& key) {
-        auto& v = ((ListNode*)that->node)->v;
-        for (auto it = v.begin(); it != v.end(); ++it) {
-            Accessor a(*it, that->owner);
-            if (a[name].str() == key)
-                return a;
-        }
-        return Accessor(nullptr, that->owner);
-    }
-    
-    // ---------- Str
-    static string str_str(Accessor* that); // this one is defined below since it depends on Yaml class
-    static int str_len(Accessor* that) {
-        auto& s = ((DataNode*)that->node)->str;
-        return s.size;
-    }
-
-    // ---------- nums
-    static double numdbl_dbl(Accessor* that) {
-        return ((DataNode*)that->node)->num_dbl;
-    }
-
-
-    struct Ops {
-        Accessor(*op_sq_int)(Accessor*, int);
-        Accessor(*op_sq_str)(Accessor*, const string&);
-        Accessor(*op_sq_chp)(Accessor*, const char*);
-        Accessor(*nodeWith)(Accessor*, const string&, const string&);
-        Accessor(*tryNodeWith)(Accessor*, const string&, const string&);
-        string(*str)(Accessor*);
-        double(*dbl)(Accessor*);
-        int(*len)(Accessor*);
-    };
-
-    static const Ops& getOp(int type) {
-        static const Ops ops[] = {
-            { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
-            { NULL, map_sq_str, map_sq_chp, NULL, NULL, NULL, NULL, map_len },
-            { list_sq_int, NULL, NULL, list_nodeWith, list_tryNodeWith, NULL, NULL, list_len },
-            { NULL, NULL, NULL, NULL, NULL, NULL, numdbl_dbl, NULL },
-            { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
-            { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
-            { NULL, NULL, NULL, NULL, NULL, str_str, NULL, str_len },
-        };
-        return ops[type];
-    }
-
-};
-
-
-
-
-
-
-template<typename T, int SZ>
-class Pool
-{
-public:
-    T* alloc() {
-        if (m_curFill >= SZ) {
-            m_cur = new T[SZ];
-            m_arrs.push_back(m_cur);
-            m_curFill = 0;
-        }
-        return &m_cur[m_curFill++];
-    }
-
-    vector<T*> m_arrs;
-    int m_curFill = SZ+1;
-    T* m_cur = nullptr;
-};
-
-
-
-
-bool isAlpha(char c) {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
-}
-bool isSpace(char c) {
-    return c == ' ' || c == '\t';
-}
-bool isWs(char c) {
-    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
-}
-bool isNum(char c) {
-    return c >= '0' && c <= '9';
-}
-
-class Yaml
-{
-private:
-    const char* m_buf;
-    int m_pos;
-    int m_size;
-
-    Node* m_root = nullptr;
-    int m_lastNewline;
-    int m_lineCount;
-    int m_lastListSize; // heuristic for the size of the next list to reserve
-
-    friend struct Accessor;
-
-    Pool<DataNode, 1240000> m_numPool;
-public:
-    Accessor root() {
-        return Accessor(m_root, this);
-    }
-    void parse(const char* inbuf)
-    {
-        m_buf = inbuf;
-        m_size = (int)strlen(inbuf);
-        m_pos = 0;
-        m_lastNewline = -1; // first newline is before the start
-        m_lineCount = 1;
-        m_lastListSize = 0;
-
-        m_root = parseNode();
-        CHECK(m_pos == m_size); // check we consumed everything
-    }
-
-
-    bool skipWs() {
-        char c = m_buf[m_pos];
-        while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
-            if (c == '\n') {
-                m_lastNewline = m_pos;
-                ++m_lineCount;
-            }
-            ++m_pos;
-            if (m_pos > m_size)
-                return false;
-            c = m_buf[m_pos];
-            if (c == '#') { // skip comment
-                while (c != '\n')
-                    c = m_buf[++m_pos];
-            }
-        }
-        return true;
-    }
-
-    
-    Node* parseNode()
-    {
-        skipWs();
-        char c = m_buf[m_pos];
-
-        if (c == '&') { // node tag, just ignore the entire tag
-            while (!isWs(c) && c != 0) 
-                c = m_buf[++m_pos];
-            skipWs();
-            c = m_buf[m_pos];
-        }
-
-        // dashed list syntax, each element starts with '- ' but can also be '-\n' if the list is of lists
-        if (c == '-' && m_size - m_pos > 2 && isWs(m_buf[m_pos + 1])) {
-            auto ret = new ListNode;
-            ret->type = NODE_LIST;
-            int myindent = m_pos - m_lastNewline;  // include the -
-            while (c == '-') {
-                if (m_pos - m_lastNewline != myindent)
-                    break;  // we arrived at a line of a different list
-                ++m_pos; // skip -  
-                auto *n = parseNode();
-                ret->v.push_back(n);
-                skipWs();  // skip the the next line to find the next -
-                c = m_buf[m_pos];
-            }
-            return ret;
-        }
-        if (c == '[') { // inline list syntax
-            auto ret = new ListNode;
-            if (m_lastListSize != 0)
-                ret->v.reserve(m_lastListSize);
-            ret->type = NODE_LIST;
-            while (true) {
-                ++m_pos; // skip ,
-                skipWs();  // there may be a space between , and next value
-                c = m_buf[m_pos];  // will be checked after the loop
-                if (c == ']') // the case of and empty list
-                    break;
-                auto *n = parseNode();
-                ret->v.push_back(n);
-                c = m_buf[m_pos];
-                if (c != ',')
-                    break;
-            }
-            CHECK(c == ']');
-            ++m_pos; // skip ]
-            m_lastListSize = (int)ret->v.size();
-            return ret;
-        }
-        // otherwise it's a literal or a map key
-        int sstart = m_pos;
-        while (true) {
-            c = m_buf[m_pos];
-            if (isWs(c) || c == ':' || c == ',' || c == ']' || c == 0) {  // literal or key can terminate with these
-                break;
-            }
-            ++m_pos;
-        }
-        Str s(m_buf + sstart, m_pos - sstart);
-
-        skipWs();  // might be spaces after key and before :
-        c = m_buf[m_pos];
-        if (c == ':')  // it's the start of a map
-        { 
-            ++m_pos; // skip :
-            MapNode* m = new MapNode;
-            m->type = NODE_MAP;
-            int myindent = sstart - m_lastNewline; // include the first letter
-            Node* node = parseNode();  // first key was parsed, just need to value
-            m->v[s] = node;
-            while (true) // iterate key-values
-            {
-                skipWs();
-                if (m_pos - m_lastNewline != myindent)
-                    break;
-                int kstart = m_pos;
-                while (true) {
-                    c = m_buf[m_pos];
-                    if (isWs(c) || c == ':' || c == 0) {
-                        break;
-                    }
-                    ++m_pos;
-                }
-                Str k(m_buf + kstart, m_pos - kstart);
-                if (k.size == 0)
-                    break;  // end of file reached
-                skipWs();  // space after key name and before :
-                c = m_buf[m_pos];
-                CHECK(c == ':');
-                ++m_pos;  // skip :
-                Node* node = parseNode();
-                m->v[k] = node;
-            }
-            return m;
-        }
-        // it's not a map
-
-        c = m_buf[sstart];  // check if there'a a chance it's a number by how it starts
-        if (isNum(c) || c == '-' || c == '.') {
-            char* dend = nullptr;
-            double d = my_strtod(m_buf + sstart, &dend);
-            if (dend == s.end()) {
-             //   auto *n = new DataNode;
-                auto* n = m_numPool.alloc();
-                n->type = NODE_NUM_DBL;
-                n->num_dbl = d;
-                return n;
-            }
-        }
-
-        auto* n = new DataNode;
-        n->type = NODE_STR;
-        n->str.pos = (int)(s.start - m_buf);
-        n->str.size = s.size;
-        return n; // strEnd is the last one which was alpha so we want to end the string one after it
-    }
-
-
-};
-
-inline string Accessor::str_str(Accessor* that) {
-    auto& s = ((DataNode*)that->node)->str;
-    return string(that->owner->m_buf + s.pos, s.size);
-}
-
-
-
-
-
-
-
-
-
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include <climits>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
+#include <list>
+#include <type_traits>
+#include <array>
+#include <limits>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define SS_YAML_STRING_VIEW
+#include <string_view>
+#endif
+
+// define SS_YAML_STATS to collect ParseStats, see Yaml::stats(). Without it nothing is recorded
+#ifdef SS_YAML_STATS
+#include <chrono>
+#define SS_YAML_STAT(x) x
+#else
+#define SS_YAML_STAT(x)
+#endif
+
+#if defined(_WIN32) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define SS_YAML_LITTLE_ENDIAN
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SS_YAML_SSE2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace ss_yaml {
+using namespace std;
+
+
+
+
+#ifdef _MSC_VER
+#define SS_YAML_NORETURN __declspec(noreturn)
+#else
+#define SS_YAML_NORETURN [[noreturn]]
+#endif
+
+#define CHECK(cond) do { if (!(cond)) throw std::runtime_error("failed CHECK(" #cond ")"); } while(false)
+#define FAIL(text) do { throw std::runtime_error(text); } while(false)
+
+extern "C" double my_strtod(const char *string, char **endPtr);
+
+// a string in a buffer, does not own it
+struct Str {
+    Str(const char* s, int sz) : start(s), size(sz) {}
+    explicit Str(const char* s) : start(s), size((int)strlen(s)) {}
+    explicit Str(const string& s) : start(s.data()), size((int)s.size()) {}
+    const char* end() const { return start + size; } // one after the last character
+    string str() const { return string(start, size); }
+#ifdef SS_YAML_STRING_VIEW
+    explicit Str(string_view s) : start(s.data()), size((int)s.size()) {}
+    operator string_view() const { return string_view(start, size); }
+#endif
+
+    const char* start;
+    int size;
+};
+inline bool operator==(const Str& a, const Str& b) {
+    return a.size == b.size && memcmp(a.start, b.start, a.size) == 0;
+}
+template<typename T>
+bool operator==(const Str& a, const T& b) {
+    return operator==(a, Str(b));
+}
+template<typename T>
+bool operator!=(const Str& a, const T& b) {
+    return !(a == b);
+}
+
+// FNV-1a, used for map keys
+inline unsigned int hashStr(const char* s, int size) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < size; ++i)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+inline unsigned int hashStr(const Str& s) {
+    return hashStr(s.start, s.size);
+}
+
+// XXH64 with seed 0, for hashing whole documents
+inline uint64_t hash64(const char* p, size_t size) {
+    const uint64_t P1 = 0x9E3779B185EBCA87ull, P2 = 0xC2B2AE3D27D4EB4Full, P3 = 0x165667B19E3779F9ull;
+    const uint64_t P4 = 0x85EBCA77C2B2AE63ull, P5 = 0x27D4EB2F165667C5ull;
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; };
+    auto read64 = [](const char* q) { uint64_t v; memcpy(&v, q, 8); return v; };
+    const char* end = p + size;
+    uint64_t h;
+    if (size >= 32) {
+        uint64_t v1 = P1 + P2, v2 = P2, v3 = 0, v4 = 0 - P1;
+        for (; end - p >= 32; p += 32) {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        uint64_t v[4] = { v1, v2, v3, v4 };
+        for (int i = 0; i < 4; ++i)
+            h = (h ^ round(0, v[i])) * P1 + P4;
+    }
+    else {
+        h = P5;
+    }
+    h += size;
+    for (; end - p >= 8; p += 8)
+        h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+    if (end - p >= 4) {
+        uint32_t k;
+        memcpy(&k, p, 4);
+        h = rotl(h ^ (k * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+        h = rotl(h ^ ((unsigned char)*p * P5), 11) * P1;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+
+enum ENodeType {
+    NODE_NONE = 0,
+    NODE_MAP = 1,
+    NODE_LIST,
+    NODE_NUM_DBL,
+    NODE_NUM_LONG,
+    NODE_NUM_INT,
+    NODE_STR,
+    NODE_LAZY,
+};
+
+// how the numbers of a list are packed after its children, see Node
+enum EPacked {
+    PACKED_NONE = 0,
+    PACKED_DBL,  // all numbers, as double
+    PACKED_I64,  // all integers, as int64_t
+};
+
+// A node in the document tape. All nodes have the same size so a whole document is a single
+// array which is allocated once after counting the nodes in a first pass.
+// Lists and maps refer to their children as a contiguous run of nodes in the tape. `first` is
+// the offset of the first child relative to the node itself so a subtree does not depend on
+// where the tape is. A map with `count` entries has 2*count children, alternating key and value.
+// Key nodes also keep the hash of the key. Maps with more than MAP_LINEAR_MAX entries have their
+// entries sorted by this hash so lookup is a binary search, smaller maps are scanned linearly.
+// A lazy node is the value of a top level entry that was not parsed yet, `str` is its text and
+// `hash` is where its tape will be once it is parsed.
+// A list whose elements are all numbers also has them right after its children as a plain array
+// of double or int64_t, `packed` tells which, so they can be read as one contiguous run.
+struct Node {
+    unsigned char type;  // ENodeType
+    unsigned char packed; // EPacked, only for lists
+    unsigned int hash;   // only for map keys
+    union {
+        struct {
+            int pos;
+            int size;
+        } str;
+        double num_dbl;
+        int64_t num_long;
+        int num_int;
+        struct {
+            int first;
+            int count;
+        } cont;
+    };
+
+    const Node* children() const { return this + cont.first; }
+    const void* packedData() const { return children() + cont.count; }
+};
+
+// a run of values in a document, does not own them
+template<typename T>
+struct Span {
+    const T* data;
+    int size;
+
+    const T* begin() const { return data; }
+    const T* end() const { return data + size; }
+    const T& operator[](int i) const { return data[i]; }
+};
+
+// a fixed size row-major matrix, see Accessor::mat<T, R, C>()
+template<typename T, int R, int C>
+struct Mat {
+    T m[R][C];
+
+    T& operator()(int r, int c) { return m[r][c]; }
+    const T& operator()(int r, int c) const { return m[r][c]; }
+    T* data() { return &m[0][0]; }
+    const T* data() const { return &m[0][0]; }
+};
+
+struct Accessor;
+struct FieldKey;
+// reads an Accessor as a T, see Accessor::as()
+template<typename T>
+struct AsTraits;
+
+const int MAP_LINEAR_MAX = 8;
+
+
+class Yaml;
+
+// name of a node type for errors
+inline const char* nodeTypeName(const Node* node) {
+    static const char* names[] = { "none", "map", "list", "number", "integer", "integer", "string", "lazy" };
+    return (node == nullptr) ? "null" : names[node->type];
+}
+
+// A view of a node in a document, for reading it. It is just two pointers and is meant to be
+// passed by value, it stays valid for as long as the document. Using it in a way that does not
+// fit the type of the node throws.
+struct Accessor
+{
+    const Node* node;
+    Yaml* owner;
+
+    Accessor() : node(nullptr), owner(nullptr) {} // a null accessor, for arrays of them
+    Accessor(const Node* _node, Yaml* _owner) : node(resolve(_node, _owner)), owner(_owner) {}
+
+    Accessor operator[](int index) const {
+        expect(NODE_LIST, "operator[int]");
+        CHECK(index >= 0 && index < node->cont.count);
+        return Accessor(node->children() + index, owner);
+    }
+    Accessor operator[](const string& key) const { return get(Str(key)); }
+    Accessor operator[](const char* key) const { return get(Str(key)); }
+    // the element of a list of maps whose `name` is `key`
+    Accessor nodeWith(const string& name, const string& key) const {
+        Accessor a = tryNodeWith(name, key);
+        if (a.isNull())
+            FAIL("id not found");
+        return a;
+    }
+    // same as nodeWith, a null accessor if there isn't one. Uses an index of the list by name
+    // once there is one, see buildIndex()
+    Accessor tryNodeWith(const string& name, const string& key) const;
+    // Indexes the elements of this list by their `name` so that nodeWith() with this name is a
+    // hash lookup from now on. Returns false if an element is not a map with a string under `name`,
+    // then lookups stay a scan that throws at that element as before.
+    bool buildIndex(const string& name) const;
+    // the first element of the list with `name` equal to `key`, by going over the elements
+    const Node* scanWith(const Str& name, const FieldKey& key) const;
+
+    string str() const {
+        return view().str();
+    }
+    // the string in the document buffer, without copying it
+    Str view() const {
+        expect(NODE_STR, "view()");
+        return Str(owner_buf() + node->str.pos, node->str.size);
+    }
+    // whether this is a string with this text, does not allocate
+    bool equals(const Str& s) const {
+        return node != nullptr && node->type == NODE_STR && view() == s;
+    }
+    bool equals(const char* s) const { return equals(Str(s)); }
+    bool equals(const string& s) const { return equals(Str(s)); }
+    double dbl() const {
+        switch (node == nullptr ? NODE_NONE : (ENodeType)node->type) {
+        case NODE_NUM_DBL: return node->num_dbl;
+        case NODE_NUM_LONG: return (double)node->num_long;
+        case NODE_NUM_INT: return node->num_int;
+        default: typeError("dbl()");
+        }
+    }
+    // integers, a number that is not an integer throws
+    int64_t i64() const {
+        switch (node == nullptr ? NODE_NONE : (ENodeType)node->type) {
+        case NODE_NUM_LONG: return node->num_long;
+        case NODE_NUM_INT: return node->num_int;
+        default: typeError("i64()");
+        }
+    }
+    int i32() const {
+        if (node != nullptr && node->type == NODE_NUM_LONG)
+            FAIL("i32() of an integer that needs 64 bits");
+        expect(NODE_NUM_INT, "i32()");
+        return node->num_int;
+    }
+    // number of elements of a list or entries of a map, or length of a string
+    int len() const {
+        switch (node == nullptr ? NODE_NONE : (ENodeType)node->type) {
+        case NODE_MAP:
+        case NODE_LIST: return node->cont.count;
+        case NODE_STR: return node->str.size;
+        default: typeError("len()");
+        }
+    }
+
+    bool isNull() const { return node == nullptr; }
+
+    // The numbers of a list as one array in the document, without copying. Span<double> is for
+    // lists with a double in them and Span<int64_t> for lists of only integers. copyTo() converts.
+    template<typename T>
+    Span<T> asSpan() const {
+        static_assert(is_same<T, double>::value || is_same<T, int64_t>::value, "asSpan<double>() or asSpan<int64_t>()");
+        expect(NODE_LIST, "asSpan()");
+        if (node->cont.count == 0)
+            return Span<T>{ nullptr, 0 };
+        if (node->packed != (is_same<T, double>::value ? PACKED_DBL : PACKED_I64))
+            FAIL(node->packed == PACKED_NONE ? "asSpan() of a list that is not all numbers" : "asSpan() of the wrong number type");
+        return Span<T>{ (const T*)node->packedData(), node->cont.count };
+    }
+    // converts the first n numbers of a list, n <= len()
+    template<typename T>
+    void copyTo(T* out, int n) const;
+    // Reads a list of `rows` lists of `cols` numbers, or a flat list of rows*cols numbers, into
+    // out row by row. The shape is checked before anything is read.
+    template<typename T>
+    void copyRowMajor(T* out, int rows, int cols) const;
+
+    // the value as a T, for numbers, strings and std::array of numbers, see AsTraits
+    template<typename T>
+    T as() const { return AsTraits<T>::read(*this); }
+
+    // a matrix of R lists of C numbers, or of a flat list of R*C numbers
+    template<typename T, int R, int C>
+    Mat<T, R, C> mat() const {
+        Mat<T, R, C> ret;
+        copyRowMajor(ret.data(), R, C);
+        return ret;
+    }
+    // a square matrix into any type with operator()(row, col)
+    template<typename MatT, int sz>
+    MatT mat() const {
+        double v[sz * sz];
+        copyRowMajor(v, sz, sz);
+        MatT ret;
+        for (int i = 0; i < sz; ++i) {
+            for (int j = 0; j < sz; ++j)
+                ret(i, j) = v[i * sz + j];
+        }
+        return ret;
+    }
+
+    // the value of a key in a map, nullptr if it's not there
+    const Node* find(const Str& key) const {
+        return find(key, hashStr(key));
+    }
+    // h is hashStr(key)
+    const Node* find(const Str& key, unsigned int h) const {
+        expect(NODE_MAP, "operator[str]");
+        const Node* kv = node->children();
+        const char* buf = owner_buf();
+        int count = node->cont.count;
+        int found = -1;
+        if (count <= MAP_LINEAR_MAX) {
+            for (int i = count - 1; i >= 0; --i) { // backwards so that a repeated key takes the last value
+                const Node& k = kv[i * 2];
+                if (k.hash == h && k.str.size == key.size && memcmp(buf + k.str.pos, key.start, key.size) == 0)
+                    return &kv[i * 2 + 1];
+            }
+            return nullptr;
+        }
+        int lo = 0, hi = count;
+        while (lo < hi) { // first entry with hash >= h
+            int mid = (lo + hi) / 2;
+            if (kv[mid * 2].hash < h)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (int i = lo; i < count && kv[i * 2].hash == h; ++i) { // the sort is stable so the last match is the last value
+            const Node& k = kv[i * 2];
+            if (k.str.size == key.size && memcmp(buf + k.str.pos, key.start, key.size) == 0)
+                found = i;
+        }
+        return (found == -1) ? nullptr : &kv[found * 2 + 1];
+    }
+    Accessor get(const Str& key) const {
+        const Node* n = find(key);
+        if (n == nullptr)
+            FAIL("key not found: " + string(key.start, key.size));
+        return Accessor(n, owner);
+    }
+
+    const char* owner_buf() const; // these are defined below since they depend on Yaml class
+    static const Node* resolve(const Node* node, Yaml* owner); // parses a lazy node
+
+private:
+    void expect(int type, const char* op) const {
+        if (node == nullptr || node->type != type)
+            typeError(op);
+    }
+    SS_YAML_NORETURN void typeError(const char* op) const {
+        FAIL(string(op) + " on a " + nodeTypeName(node) + " node");
+    }
+};
+
+
+// read-only mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void open(const char* path)
+    {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            FAIL(string("failed opening ") + path);
+        LARGE_INTEGER sz;
+        GetFileSizeEx(file, &sz);
+        m_size = (size_t)sz.QuadPart;
+        if (m_size > 0) {
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping != NULL) {
+                m_data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping); // the view keeps the mapping alive
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd == -1)
+            FAIL(string("failed opening ") + path);
+        struct stat st;
+        fstat(fd, &st);
+        m_size = (size_t)st.st_size;
+        if (m_size > 0) {
+            void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+                m_data = (const char*)p;
+        }
+        ::close(fd); // the mapping keeps the file alive
+#endif
+        if (m_size > 0 && m_data == nullptr) {
+            m_size = 0;
+            FAIL(string("failed mapping ") + path);
+        }
+    }
+    void close()
+    {
+        if (m_data != nullptr) {
+#ifdef _WIN32
+            UnmapViewOfFile(m_data);
+#else
+            munmap((void*)m_data, m_size);
+#endif
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const char* data() const { return (m_data != nullptr) ? m_data : ""; }
+    size_t size() const { return m_size; }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+
+bool isAlpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+bool isSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+bool isWs(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+bool isNum(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// ---------------------------------------------------------------------------------------------
+// Scanners for the inner loops of the parser. Each has a scalar version and SSE2/AVX2 versions
+// that classify 16/32 characters at a time. The best one for the cpu is chosen once at runtime.
+// The conversion for Accessor::copyTo is chosen the same way.
+
+#if defined(_MSC_VER)
+#define SS_YAML_AVX2_FUNC
+#else
+#define SS_YAML_AVX2_FUNC __attribute__((target("avx2")))
+#endif
+
+inline int lowBit(unsigned int x) { // index of the lowest set bit, x != 0
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+inline int highBit(unsigned int x) { // index of the highest set bit, x != 0
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse(&i, x);
+    return (int)i;
+#else
+    return 31 - __builtin_clz(x);
+#endif
+}
+inline int lowBit64(uint64_t x) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#elif defined(_MSC_VER)
+    return ((unsigned int)x != 0) ? lowBit((unsigned int)x) : 32 + lowBit((unsigned int)(x >> 32));
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+inline int highBit64(uint64_t x) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanReverse64(&i, x);
+    return (int)i;
+#elif defined(_MSC_VER)
+    return ((unsigned int)(x >> 32) != 0) ? 32 + highBit((unsigned int)(x >> 32)) : highBit((unsigned int)x);
+#else
+    return 63 - __builtin_clzll(x);
+#endif
+}
+inline int bitCount(unsigned int x) {
+#ifdef _MSC_VER
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    return (int)((((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+#else
+    return __builtin_popcount(x);
+#endif
+}
+
+// classification of a block of 64 characters for the structural index, bit i is character i
+struct BlockMasks {
+    uint64_t ws;     // ' ' '\t' '\r' '\n'
+    uint64_t nl;     // '\n'
+    uint64_t punct;  // ':' ',' ']'
+    uint64_t hash;   // '#'
+    uint64_t zero;   // 0
+};
+
+struct ScanFuncs {
+    // first character in [p,end) that is not whitespace. adds the number of newlines passed to
+    // newlines and sets lastNl to the last one of them
+    const char* (*ws)(const char* p, const char* end, int& newlines, const char*& lastNl);
+    // first character in [p,end) that terminates a literal: whitespace : , ] or 0
+    const char* (*literal)(const char* p, const char* end);
+    // first character in [p,end) that terminates a map key: whitespace : or 0
+    const char* (*key)(const char* p, const char* end);
+    // classify the 64 characters at p
+    void (*classify)(const char* p, BlockMasks& m);
+    // converts n doubles to floats, for Accessor::copyTo
+    void (*toFloats)(const double* in, float* out, int n);
+    // start of the first line after the one p is in that is not in a block indented by `indent`,
+    // see inBlock(), or end
+    const char* (*blockEnd)(const char* p, const char* end, int indent, bool keyValue);
+};
+
+// whether the line at p is still in a block of lines indented by `indent`: it is indented at least
+// that much or it is blank or a comment. If the block is the value of a key, an element of a dashed
+// list one less indented is in it too, which is how a list is the value of a key at the same
+// indentation.
+inline bool inBlock(const char* p, const char* end, int indent, bool keyValue) {
+    const char* q = p;
+    while (q < end && (*q == ' ' || *q == '\t'))
+        ++q;
+    int lead = (int)(q - p);
+    if (lead >= indent || q == end)
+        return true;
+    char c = *q;
+    return c == '\n' || c == '\r' || c == '#' || (keyValue && lead == indent - 1 && c == '-' && q + 1 < end && isWs(q[1]));
+}
+// whether the [ and ] in [p, end) pair up. An inline list can go on to lines that are not
+// indented, this tells if one ends where its block does
+inline bool bracketsClose(const char* p, const char* end) {
+    int depth = 0;
+    for (; p < end; ++p)
+        depth += (*p == '[') - (*p == ']');
+    return depth == 0;
+}
+inline const char* blockEnd_scalar(const char* p, const char* end, int indent, bool keyValue) {
+    while (true) {
+        const char* nl = (const char*)memchr(p, '\n', end - p);
+        if (nl == nullptr)
+            return end;
+        p = nl + 1;
+        if (!inBlock(p, end, indent, keyValue))
+            return p;
+    }
+}
+
+inline const char* scanWs_scalar(const char* p, const char* end, int& newlines, const char*& lastNl) {
+    for (; p < end && isWs(*p); ++p) {
+        if (*p == '\n') {
+            ++newlines;
+            lastNl = p;
+        }
+    }
+    return p;
+}
+inline const char* scanLiteral_scalar(const char* p, const char* end) {
+    for (; p < end; ++p) {
+        char c = *p;
+        if (isWs(c) || c == ':' || c == ',' || c == ']' || c == 0)
+            break;
+    }
+    return p;
+}
+inline const char* scanKey_scalar(const char* p, const char* end) {
+    for (; p < end; ++p) {
+        char c = *p;
+        if (isWs(c) || c == ':' || c == 0)
+            break;
+    }
+    return p;
+}
+
+inline void toFloats_scalar(const double* in, float* out, int n) {
+    for (int i = 0; i < n; ++i)
+        out[i] = (float)in[i];
+}
+
+inline void classify_scalar(const char* p, BlockMasks& m) {
+    m.ws = m.nl = m.punct = m.hash = m.zero = 0;
+    for (int i = 0; i < 64; ++i) {
+        uint64_t bit = (uint64_t)1 << i;
+        char c = p[i];
+        if (isWs(c))
+            m.ws |= bit;
+        if (c == '\n')
+            m.nl |= bit;
+        else if (c == ':' || c == ',' || c == ']')
+            m.punct |= bit;
+        else if (c == '#')
+            m.hash |= bit;
+        else if (c == 0)
+            m.zero |= bit;
+    }
+}
+
+#ifdef SS_YAML_SSE2
+
+// newline bits in nlMask that are below the first non-ws character are counted
+inline void countNewlines(const char* p, unsigned int nlMask, int& newlines, const char*& lastNl) {
+    if (nlMask != 0) {
+        newlines += bitCount(nlMask);
+        lastNl = p + highBit(nlMask);
+    }
+}
+
+inline const char* scanWs_sse2(const char* p, const char* end, int& newlines, const char*& lastNl) {
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), cr = _mm_set1_epi8('\r'), nl = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i isNl = _mm_cmpeq_epi8(v, nl);
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)), _mm_or_si128(_mm_cmpeq_epi8(v, cr), isNl));
+        unsigned int notWs = ~(unsigned int)_mm_movemask_epi8(ws) & 0xFFFF;
+        unsigned int nlMask = (unsigned int)_mm_movemask_epi8(isNl);
+        if (notWs != 0) {
+            int i = lowBit(notWs);
+            countNewlines(p, nlMask & ((1u << i) - 1), newlines, lastNl);
+            return p + i;
+        }
+        countNewlines(p, nlMask, newlines, lastNl);
+    }
+    return scanWs_scalar(p, end, newlines, lastNl);
+}
+inline const char* scanLiteral_sse2(const char* p, const char* end) {
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), cr = _mm_set1_epi8('\r'), nl = _mm_set1_epi8('\n');
+    const __m128i colon = _mm_set1_epi8(':'), comma = _mm_set1_epi8(','), close = _mm_set1_epi8(']'), zero = _mm_setzero_si128();
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)), _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, nl)));
+        __m128i st = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)), _mm_or_si128(_mm_cmpeq_epi8(v, close), _mm_cmpeq_epi8(v, zero)));
+        unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_or_si128(ws, st));
+        if (m != 0)
+            return p + lowBit(m);
+    }
+    return scanLiteral_scalar(p, end);
+}
+inline const char* scanKey_sse2(const char* p, const char* end) {
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), cr = _mm_set1_epi8('\r'), nl = _mm_set1_epi8('\n');
+    const __m128i colon = _mm_set1_epi8(':'), zero = _mm_setzero_si128();
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)), _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, nl)));
+        __m128i st = _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, zero));
+        unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_or_si128(ws, st));
+        if (m != 0)
+            return p + lowBit(m);
+    }
+    return scanKey_scalar(p, end);
+}
+
+inline void classify_sse2(const char* p, BlockMasks& m) {
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), cr = _mm_set1_epi8('\r'), nl = _mm_set1_epi8('\n');
+    const __m128i colon = _mm_set1_epi8(':'), comma = _mm_set1_epi8(','), close = _mm_set1_epi8(']'), hash = _mm_set1_epi8('#'), zero = _mm_setzero_si128();
+    m.ws = m.nl = m.punct = m.hash = m.zero = 0;
+    for (int i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i isNl = _mm_cmpeq_epi8(v, nl);
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)), _mm_or_si128(_mm_cmpeq_epi8(v, cr), isNl));
+        __m128i punct = _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, close)));
+        m.ws |= (uint64_t)(unsigned int)_mm_movemask_epi8(ws) << i;
+        m.nl |= (uint64_t)(unsigned int)_mm_movemask_epi8(isNl) << i;
+        m.punct |= (uint64_t)(unsigned int)_mm_movemask_epi8(punct) << i;
+        m.hash |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, hash)) << i;
+        m.zero |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) << i;
+    }
+}
+
+inline const char* blockEnd_sse2(const char* p, const char* end, int indent, bool keyValue) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), nl));
+        for (; m != 0; m &= m - 1) {
+            const char* line = p + lowBit(m) + 1;
+            if (!inBlock(line, end, indent, keyValue))
+                return line;
+        }
+    }
+    return blockEnd_scalar(p, end, indent, keyValue);
+}
+
+inline void toFloats_sse2(const double* in, float* out, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(in + i));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2));
+        _mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+    }
+    toFloats_scalar(in + i, out + i, n - i);
+}
+
+SS_YAML_AVX2_FUNC inline const char* scanWs_avx2(const char* p, const char* end, int& newlines, const char*& lastNl) {
+    const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), cr = _mm256_set1_epi8('\r'), nl = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i isNl = _mm256_cmpeq_epi8(v, nl);
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)), _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), isNl));
+        unsigned int notWs = ~(unsigned int)_mm256_movemask_epi8(ws);
+        unsigned int nlMask = (unsigned int)_mm256_movemask_epi8(isNl);
+        if (notWs != 0) {
+            int i = lowBit(notWs);
+            countNewlines(p, nlMask & (i == 0 ? 0 : (0xFFFFFFFFu >> (32 - i))), newlines, lastNl);
+            return p + i;
+        }
+        countNewlines(p, nlMask, newlines, lastNl);
+    }
+    return scanWs_sse2(p, end, newlines, lastNl);
+}
+SS_YAML_AVX2_FUNC inline const char* scanLiteral_avx2(const char* p, const char* end) {
+    const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), cr = _mm256_set1_epi8('\r'), nl = _mm256_set1_epi8('\n');
+    const __m256i colon = _mm256_set1_epi8(':'), comma = _mm256_set1_epi8(','), close = _mm256_set1_epi8(']'), zero = _mm256_setzero_si256();
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)), _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, nl)));
+        __m256i st = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)), _mm256_or_si256(_mm256_cmpeq_epi8(v, close), _mm256_cmpeq_epi8(v, zero)));
+        unsigned int m = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(ws, st));
+        if (m != 0)
+            return p + lowBit(m);
+    }
+    return scanLiteral_sse2(p, end);
+}
+SS_YAML_AVX2_FUNC inline const char* scanKey_avx2(const char* p, const char* end) {
+    const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), cr = _mm256_set1_epi8('\r'), nl = _mm256_set1_epi8('\n');
+    const __m256i colon = _mm256_set1_epi8(':'), zero = _mm256_setzero_si256();
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)), _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, nl)));
+        __m256i st = _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, zero));
+        unsigned int m = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(ws, st));
+        if (m != 0)
+            return p + lowBit(m);
+    }
+    return scanKey_sse2(p, end);
+}
+
+SS_YAML_AVX2_FUNC inline void classify_avx2(const char* p, BlockMasks& m) {
+    const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), cr = _mm256_set1_epi8('\r'), nl = _mm256_set1_epi8('\n');
+    const __m256i colon = _mm256_set1_epi8(':'), comma = _mm256_set1_epi8(','), close = _mm256_set1_epi8(']'), hash = _mm256_set1_epi8('#'), zero = _mm256_setzero_si256();
+    m.ws = m.nl = m.punct = m.hash = m.zero = 0;
+    for (int i = 0; i < 64; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i isNl = _mm256_cmpeq_epi8(v, nl);
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)), _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), isNl));
+        __m256i punct = _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_or_si256(_mm256_cmpeq_epi8(v, comma), _mm256_cmpeq_epi8(v, close)));
+        m.ws |= (uint64_t)(unsigned int)_mm256_movemask_epi8(ws) << i;
+        m.nl |= (uint64_t)(unsigned int)_mm256_movemask_epi8(isNl) << i;
+        m.punct |= (uint64_t)(unsigned int)_mm256_movemask_epi8(punct) << i;
+        m.hash |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, hash)) << i;
+        m.zero |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) << i;
+    }
+}
+
+SS_YAML_AVX2_FUNC inline const char* blockEnd_avx2(const char* p, const char* end, int indent, bool keyValue) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        unsigned int m = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), nl));
+        for (; m != 0; m &= m - 1) {
+            const char* line = p + lowBit(m) + 1;
+            if (!inBlock(line, end, indent, keyValue))
+                return line;
+        }
+    }
+    return blockEnd_sse2(p, end, indent, keyValue);
+}
+
+SS_YAML_AVX2_FUNC inline void toFloats_avx2(const double* in, float* out, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i + 4));
+        _mm256_storeu_ps(out + i, _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+    }
+    toFloats_sse2(in + i, out + i, n - i);
+}
+
+inline bool cpuHasAvx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) // the OS saves the ymm registers
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // SS_YAML_SSE2
+
+inline const ScanFuncs& scanFuncs() {
+    static const ScanFuncs funcs = []() {
+#ifdef SS_YAML_SSE2
+        if (cpuHasAvx2())
+            return ScanFuncs{ scanWs_avx2, scanLiteral_avx2, scanKey_avx2, classify_avx2, toFloats_avx2, blockEnd_avx2 };
+        return ScanFuncs{ scanWs_sse2, scanLiteral_sse2, scanKey_sse2, classify_sse2, toFloats_sse2, blockEnd_sse2 };
+#else
+        return ScanFuncs{ scanWs_scalar, scanLiteral_scalar, scanKey_scalar, classify_scalar, toFloats_scalar, blockEnd_scalar };
+#endif
+    }();
+    return funcs;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Tokens. The grammar reads the document as a stream of these, either lexed on the fly by Lexer
+// or read from the structural index built up front by buildStructIndex.
+
+enum ETokenKind {
+    TOK_END = 0,     // end of the buffer, or a 0 character in it
+    TOK_SCALAR = 's',
+    TOK_DASH = '-',  // '-' followed by whitespace, starts an element of a dashed list
+    TOK_OPEN = '[',
+    TOK_CLOSE = ']',
+    TOK_COMMA = ',',
+    TOK_COLON = ':',
+};
+
+struct Token {
+    int pos;   // offset in the buffer
+    int len;
+    int col;   // pos minus the position of the newline before it, this is what indentation is compared by
+    int kind;  // ETokenKind
+};
+
+// lexes tokens directly from the buffer
+class Lexer
+{
+public:
+    // lex [begin,end) of buf, columns count from the line begin is on
+    void start(const char* buf, int begin, int end) {
+        m_buf = buf;
+        m_size = end;
+        m_pos = begin;
+        m_lastNewline = begin - 1; // first newline is before the start
+        while (m_lastNewline >= 0 && buf[m_lastNewline] != '\n')
+            --m_lastNewline;
+        m_lineCount = 1;
+        m_hasPeek = false;
+    }
+    const Token& peek() {
+        if (!m_hasPeek) {
+            lex(m_peek);
+            m_hasPeek = true;
+        }
+        return m_peek;
+    }
+    Token next() {
+        peek();
+        m_hasPeek = false;
+        return m_peek;
+    }
+    bool ready() { // all the input is there
+        return true;
+    }
+    // the buffer moved to buf and has content up to end, the current token is lexed again if
+    // it was the end
+    void extend(const char* buf, int end) {
+        m_buf = buf;
+        m_size = end;
+        if (m_hasPeek && m_peek.kind == TOK_END)
+            m_hasPeek = false;
+    }
+    // the first n characters of the buffer were removed
+    void discard(int n) {
+        m_pos -= n;
+        m_lastNewline -= n;
+        m_peek.pos -= n;
+    }
+    const ScanFuncs& scan() const {
+        return *m_scan;
+    }
+
+private:
+    char at(int pos) const { // the buffer does not need to be 0 terminated
+        return (pos < m_size) ? m_buf[pos] : 0;
+    }
+
+    void skipWs() {
+        while (true) {
+            const char* p = m_buf + m_pos;
+            const char* q = p;
+            if (isWs(at(m_pos))) {
+                const char* lastNl = nullptr;
+                q = m_scan->ws(p, m_buf + m_size, m_lineCount, lastNl);
+                if (lastNl != nullptr)
+                    m_lastNewline = (int)(lastNl - m_buf);
+                m_pos = (int)(q - m_buf);
+            }
+            if (m_pos >= m_size || *q != '#' || (q == p && m_pos != m_lastNewline + 1))
+                return;
+            // comment after whitespace or at the start of the line, skip to the newline which is whitespace for the next round
+            const char* nl = (const char*)memchr(q, '\n', m_size - m_pos);
+            m_pos = (nl != nullptr) ? (int)(nl - m_buf) : m_size;
+        }
+    }
+
+    void lex(Token& t) {
+        skipWs();
+        char c = at(m_pos);
+        t.pos = m_pos;
+        t.col = m_pos - m_lastNewline;
+        t.len = 1;
+        if (c == 0) { // end of buffer, or a 0 which can't be parsed
+            t.kind = TOK_END;
+            t.len = 0;
+            return;
+        }
+        if (c == ':' || c == ',' || c == ']' || c == '[')
+            t.kind = c;
+        else if (c == '-' && isWs(at(m_pos + 1)))
+            t.kind = TOK_DASH;
+        else {
+            t.kind = TOK_SCALAR;
+            t.len = (int)(m_scan->literal(m_buf + m_pos + 1, m_buf + m_size) - m_buf) - m_pos;
+        }
+        m_pos += t.len;
+    }
+
+    const char* m_buf;
+    int m_pos;
+    int m_size;
+    int m_lastNewline;
+    int m_lineCount;
+    const ScanFuncs* m_scan = &scanFuncs();
+    Token m_peek;
+    bool m_hasPeek;
+};
+
+// Stage 1 of the indexed parse: classifies the whole buffer 64 characters at a time with bitmasks
+// and records all the tokens with their indentation. A scalar is a run of characters that are not
+// whitespace, : , ] or 0. Token starts and ends are the edges of these runs, so only the tokens
+// themselves are visited one by one.
+// Indexes [begin,size) of buf, begin is at the start of a line.
+inline void buildStructIndex(const char* buf, int begin, int size, vector<Token>& tokens)
+{
+    const ScanFuncs& scan = scanFuncs();
+    tokens.clear();
+    tokens.reserve((size - begin) / 8 + 1);
+    int open = -1;          // index of the scalar token that has not ended yet
+    int lastNl = begin - 1; // position of the last newline before the current block
+    uint64_t prevWs = 1;    // whether the character before the block is whitespace (the start counts as one for comments)
+    uint64_t prevRun = 0;   // whether the character before the block is part of a scalar
+    bool inComment = false; // a comment continues from the previous block
+    char tail[64];
+
+    for (int base = begin; base < size; base += 64) {
+        const char* p = buf + base;
+        if (size - base < 64) { // pad the last block with spaces, they don't make tokens
+            memset(tail, ' ', 64);
+            memcpy(tail, p, size - base);
+            p = tail;
+        }
+        BlockMasks m;
+        scan.classify(p, m);
+
+        // comments start with a # after whitespace and end before the next newline
+        uint64_t comment = 0;
+        if (inComment) {
+            if (m.nl == 0) {
+                comment = ~(uint64_t)0;
+            }
+            else {
+                comment = ((uint64_t)1 << lowBit64(m.nl)) - 1;
+                inComment = false;
+            }
+        }
+        uint64_t cand = m.hash & ((m.ws << 1) | prevWs) & ~comment;
+        while (cand != 0) {
+            int i = lowBit64(cand);
+            uint64_t fromHere = ~(uint64_t)0 << i;
+            uint64_t nlAfter = m.nl & fromHere;
+            if (nlAfter == 0) {
+                comment |= fromHere;
+                inComment = true;
+                break;
+            }
+            uint64_t upToNl = ((uint64_t)1 << lowBit64(nlAfter)) - 1;
+            comment |= fromHere & upToNl;
+            cand &= ~upToNl;
+        }
+
+        uint64_t run = ~(m.ws | m.punct | m.zero | comment);
+        uint64_t runBefore = (run << 1) | prevRun;
+        uint64_t events = (run & ~runBefore) | (~run & runBefore) | ((m.punct | m.zero) & ~comment);
+        while (events != 0) {
+            int i = lowBit64(events);
+            events &= events - 1;
+            int pos = base + i;
+            if (pos >= size)
+                break;
+            uint64_t below = m.nl & (((uint64_t)1 << i) - 1);
+            int col = pos - ((below != 0) ? base + highBit64(below) : lastNl);
+            uint64_t bit = (uint64_t)1 << i;
+            if (open != -1 && (run & bit) == 0) { // the character after a scalar
+                tokens[open].len = pos - tokens[open].pos;
+                open = -1;
+            }
+            char c = buf[pos];
+            if ((comment & bit) != 0)
+                continue;
+            if ((m.zero & bit) != 0) {
+                tokens.push_back(Token{ pos, 0, col, TOK_END });
+                return;
+            }
+            if ((m.punct & bit) != 0) {
+                tokens.push_back(Token{ pos, 1, col, c });
+                continue;
+            }
+            if ((run & bit) == 0)
+                continue;
+            // start of a run, which may begin with [ or be a dash
+            while (c == '[') {
+                tokens.push_back(Token{ pos, 1, col, TOK_OPEN });
+                ++pos;
+                ++col;
+                if (pos >= size)
+                    break;
+                c = buf[pos];
+                if (isWs(c) || c == ':' || c == ',' || c == ']' || c == 0)
+                    break;
+            }
+            if (pos >= size || isWs(c) || c == ':' || c == ',' || c == ']' || c == 0)
+                continue;
+            if (c == '-' && pos + 1 < size && isWs(buf[pos + 1])) {
+                tokens.push_back(Token{ pos, 1, col, TOK_DASH });
+                continue;
+            }
+            open = (int)tokens.size();
+            tokens.push_back(Token{ pos, 0, col, TOK_SCALAR });
+        }
+        if (m.nl != 0)
+            lastNl = base + highBit64(m.nl);
+        prevWs = m.ws >> 63;
+        prevRun = run >> 63;
+    }
+    if (open != -1)
+        tokens[open].len = size - tokens[open].pos;
+    tokens.push_back(Token{ size, 0, size - lastNl, TOK_END });
+}
+
+// Stage 2 of the indexed parse reads the tokens from the index
+class IndexedLexer
+{
+public:
+    explicit IndexedLexer(const vector<Token>& tokens) : m_tokens(tokens) {}
+    void start(const char*, int, int) {
+        m_next = 0;
+    }
+    bool ready() {
+        return true;
+    }
+    const Token& peek() {
+        return m_tokens[m_next];
+    }
+    Token next() {
+        const Token& t = m_tokens[m_next];
+        if (t.kind != TOK_END)
+            ++m_next;
+        return t;
+    }
+private:
+    const vector<Token>& m_tokens;
+    int m_next;
+};
+
+// The paths a projected parse keeps, see ParseOptions::projection. Paths are written as for Path.
+// The keys on the way to a path are kept with only the keys under them that are on a path, and the
+// value at the end of a path is kept whole. List steps keep every element so that indexes don't
+// change and * keeps every key, so a key keeps what is on the paths through it or through a * next
+// to it.
+class Projection
+{
+public:
+    struct Step {
+        string key;
+        bool all = false; // a path ends here
+        vector<unique_ptr<Step>> children;
+
+        // the key's own step has what the * next to it has too, see spread()
+        const Step* find(const Str& k) const {
+            const Step* any = nullptr;
+            for (auto& c : children) {
+                if (Str(c->key) == k)
+                    return c.get();
+                if (c->key == "*")
+                    any = c.get();
+            }
+            return any;
+        }
+    };
+
+    Projection() {}
+    explicit Projection(const vector<string>& paths) {
+        for (auto& p : paths)
+            add(p);
+    }
+    void add(const string& path)
+    {
+        Step* s = &m_paths;
+        size_t p = 0, n = path.size();
+        while (p < n) {
+            if (path[p] == '[') { // every element is kept
+                p = path.find(']', p);
+                if (p == string::npos)
+                    FAIL("missing ] in path " + path);
+                ++p;
+                continue;
+            }
+            if (path[p] == '.' && p != 0)
+                ++p;
+            size_t e = min(path.find_first_of(".[", p), n);
+            if (e == p)
+                FAIL("empty key in path " + path);
+            s = child(*s, path.substr(p, e - p));
+            p = e;
+        }
+        s->all = true;
+        m_root.all = false;
+        m_root.children.clear();
+        unite(m_root, m_paths);
+        spread(m_root);
+    }
+    const Step& root() const { return m_root; }
+
+private:
+    static Step* child(Step& s, const string& key) {
+        for (auto& c : s.children) {
+            if (c->key == key)
+                return c.get();
+        }
+        s.children.push_back(unique_ptr<Step>(new Step));
+        s.children.back()->key = key;
+        return s.children.back().get();
+    }
+    // adds the paths under `from` to `to`
+    static void unite(Step& to, const Step& from) {
+        to.all = to.all || from.all;
+        for (auto& c : from.children)
+            unite(*child(to, c->key), *c);
+    }
+    // gives every key the paths of the * next to it
+    static void spread(Step& s) {
+        const Step* any = nullptr;
+        for (auto& c : s.children) {
+            if (c->key == "*")
+                any = c.get();
+        }
+        for (auto& c : s.children) {
+            if (any != nullptr && c.get() != any)
+                unite(*c, *any);
+            spread(*c);
+        }
+    }
+
+    Step m_paths; // as they were added
+    Step m_root;  // with spread()
+};
+
+// Lexes only what a Projection keeps. A key that is not kept is skipped with its value by lines,
+// the value ends at the first line that is not indented past the key. An inline list value whose
+// brackets don't close there is skipped by tokens instead. The grammar has no empty block maps, so
+// the first key of a map is given as an empty key with an empty value when it is skipped. This
+// keeps the map a map and the elements of a list where they are, and Tape drops the empty key.
+class ProjectedLexer
+{
+public:
+    explicit ProjectedLexer(const Projection& projection) : m_projection(projection) {}
+
+    void start(const char* buf, int begin, int end) {
+        m_buf = buf;
+        m_end = end;
+        m_lex.start(buf, begin, end);
+        m_open.clear();
+        m_flowDepth = 0;
+        m_prevKind = TOK_END;
+        m_prevTag = false;
+        m_queued = 0;
+        m_hasPeek = false;
+    }
+    const Token& peek() {
+        if (!m_hasPeek) {
+            fetch(m_peek);
+            m_hasPeek = true;
+        }
+        return m_peek;
+    }
+    Token next() {
+        peek();
+        m_hasPeek = false;
+        return m_peek;
+    }
+    bool ready() {
+        return true;
+    }
+
+private:
+    void fetch(Token& t)
+    {
+        if (m_queued > 0) {
+            t = m_queue[2 - m_queued--];
+        }
+        else {
+            while (!take(m_lex.next(), t))
+                ;
+        }
+        if (t.kind == TOK_OPEN)
+            ++m_flowDepth;
+        else if (t.kind == TOK_CLOSE && m_flowDepth > 0)
+            --m_flowDepth;
+        // a tag is skipped by the grammar where a value starts, as in runGrammar()
+        m_prevTag = (t.kind == TOK_SCALAR && t.len > 0 && m_buf[t.pos] == '&' && !m_prevTag);
+        m_prevKind = t.kind;
+    }
+
+    // whether t is given out, as out which is an empty key for the first key of a map that is skipped
+    bool take(const Token& t, Token& out)
+    {
+        out = t;
+        if (t.kind != TOK_SCALAR || m_flowDepth > 0 || m_lex.peek().kind != TOK_COLON)
+            return true;
+        while (!m_open.empty() && m_open.back().col >= t.col)
+            m_open.pop_back();
+        const Projection::Step* parent = m_open.empty() ? &m_projection.root() : m_open.back().step;
+        if (parent == nullptr || parent->all)
+            return true; // everything under parent is kept
+        const Projection::Step* step = parent->find(Str(m_buf + t.pos, t.len));
+        if (step != nullptr) {
+            m_open.push_back(Open{ t.col, step->all ? nullptr : step });
+            return true;
+        }
+
+        Token colon = m_lex.next();
+        const char* resume = m_lex.scan().blockEnd(m_buf + colon.pos, m_buf + m_end, t.col, true);
+        if (m_lex.peek().kind == TOK_OPEN && !bracketsClose(m_buf + m_lex.peek().pos, resume)) {
+            int depth = 0;
+            do {
+                Token f = m_lex.next();
+                if (f.kind == TOK_END)
+                    break; // the grammar reports it
+                depth += (f.kind == TOK_OPEN) - (f.kind == TOK_CLOSE);
+            } while (depth > 0);
+        }
+        else {
+            m_lex.start(m_buf, (int)(resume - m_buf), m_end);
+        }
+        if (m_prevKind != TOK_COLON && m_prevKind != TOK_DASH && m_prevKind != TOK_END && !m_prevTag)
+            return false;
+        out = Token{ t.pos, 0, t.col, TOK_SCALAR };
+        m_queue[0] = colon;
+        m_queue[1] = Token{ colon.pos + 1, 0, colon.col + 1, TOK_SCALAR };
+        m_queued = 2;
+        return true;
+    }
+
+    struct Open {
+        int col;
+        const Projection::Step* step; // null if the value of the key is kept whole
+    };
+    const Projection& m_projection;
+    Lexer m_lex;
+    const char* m_buf;
+    int m_end;
+    vector<Open> m_open; // the kept keys that may have keys under them
+    int m_flowDepth;
+    int m_prevKind;      // of the last token given out
+    bool m_prevTag;      // it was a tag, so a value starts after it
+    Token m_queue[2];    // the colon and the empty value of an empty key
+    int m_queued;
+    Token m_peek;
+    bool m_hasPeek;
+};
+
+// ---------------------------------------------------------------------------------------------
+// Events of a parse. A handler derives from Handler and hides the events it wants, the grammar is
+// a template over the handler so the calls are not virtual and nothing is allocated per event.
+struct Handler
+{
+    // numbers are reported with onNumber(), otherwise every scalar goes to onScalar()
+    static const bool wantNumbers = true;
+    // integers that fit in 64 bits are reported with onInt(), otherwise they go to onNumber()
+    static const bool wantIntegers = false;
+
+    void onMapStart() {}        // followed by onKey() of the first key
+    void onKey(const Str&) {}   // followed by the value of the key
+    void onScalar(const Str&) {}
+    void onNumber(double) {}
+    void onInt(int64_t) {}
+    void onListStart(int /*sizeHint*/) {} // the size of the last list that ended, to reserve for
+    void onEnd() {}             // end of the innermost map or list
+};
+
+#ifdef SS_YAML_LITTLE_ENDIAN
+// whether the 8 characters in v are all digits
+inline bool allDigits8(uint64_t v) {
+    return (v & 0xF0F0F0F0F0F0F0F0ull) == 0x3030303030303030ull &&
+           ((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) == 0x3030303030303030ull;
+}
+// the value of 8 digits, the first one in the low byte. Pairs, then groups of 4, then all 8
+inline uint32_t parseDigits8(uint64_t v) {
+    v -= 0x3030303030303030ull;
+    v = (v * 10 + (v >> 8)) & 0x00FF00FF00FF00FFull;
+    v = (v * 100 + (v >> 16)) & 0x0000FFFF0000FFFFull;
+    return (uint32_t)((v * 10000 + (v >> 32)) & 0xFFFFFFFF);
+}
+#endif
+
+enum ENumberKind {
+    NUMBER_NONE,
+    NUMBER_INT,
+    NUMBER_DBL,
+};
+
+// Classifies s as a number, -?(d+(.d*)?|.d+)([eE][+-]?d+)? which is what my_strtod reads fully.
+// An integer that fits in int64 is parsed to i, other numbers are parsed to d. end is the end of
+// the buffer.
+inline ENumberKind parseNumber(const Str& s, const char* end, int64_t& i, double& d)
+{
+    const char* p = s.start;
+    const char* e = s.end();
+    bool neg = (p < e && *p == '-');
+    if (neg)
+        ++p;
+    while (e - p >= 2 && p[0] == '0' && isNum(p[1])) // leading zeros don't count for the size of an int64
+        ++p;
+    const char* digits = p;
+    uint64_t v = 0;
+#ifdef SS_YAML_LITTLE_ENDIAN
+    while (e - p >= 8 && p - digits < 16) { // the first 16 digits 8 at a time, the buffer has the 8 characters
+        uint64_t chunk;
+        memcpy(&chunk, p, 8);
+        if (!allDigits8(chunk))
+            break;
+        v = v * 100000000 + parseDigits8(chunk);
+        p += 8;
+    }
+#endif
+    while (p < e && isNum(*p)) {
+        v = v * 10 + (*p - '0'); // wraps after 19 digits, which are not an int64 anyway
+        ++p;
+    }
+    int intDigits = (int)(p - digits);
+    if (p == e) {
+        if (intDigits == 0)
+            return NUMBER_NONE;
+        // "-0" stays a double so the sign survives
+        if (intDigits <= 19 && v <= (uint64_t)INT64_MAX + neg && !(neg && v == 0)) {
+            i = neg ? (int64_t)(0 - v) : (int64_t)v;
+            return NUMBER_INT;
+        }
+    }
+    else {
+        int fracDigits = 0;
+        if (*p == '.') {
+            ++p;
+            while (p < e && isNum(*p))
+                ++p, ++fracDigits;
+        }
+        if (intDigits + fracDigits == 0)
+            return NUMBER_NONE;
+        if (p < e && (*p == 'e' || *p == 'E')) {
+            ++p;
+            if (p < e && (*p == '+' || *p == '-'))
+                ++p;
+            if (p == e || !isNum(*p))
+                return NUMBER_NONE;
+            while (p < e && isNum(*p))
+                ++p;
+        }
+        if (p != e)
+            return NUMBER_NONE;
+    }
+
+    if (s.end() < end) { // my_strtod stops at the character after the literal
+        d = my_strtod(s.start, nullptr);
+    }
+    else { // the literal is at the very end of the buffer, parse a terminated copy
+        string tmp(s.start, s.size);
+        d = my_strtod(tmp.c_str(), nullptr);
+    }
+    return NUMBER_DBL;
+}
+
+// A value nodeWith() looks for. A number is compared by its value the way the document reads it,
+// so "123" finds `id: 123`, and anything else by its text.
+struct FieldKey {
+    ENumberKind kind = NUMBER_NONE;
+    Str s;
+    int64_t i = 0; // NUMBER_INT
+    double d = 0;  // NUMBER_DBL
+
+    FieldKey() : s(nullptr, 0) {}
+    explicit FieldKey(const Str& key) : s(key) {
+        kind = parseNumber(key, key.end(), i, d);
+    }
+    // the value of v, false if it is not a string or a number
+    bool set(const Node* v, const char* buf) {
+        switch (v->type) {
+        case NODE_STR: kind = NUMBER_NONE; s = Str(buf + v->str.pos, v->str.size); return true;
+        case NODE_NUM_INT: kind = NUMBER_INT; i = v->num_int; return true;
+        case NODE_NUM_LONG: kind = NUMBER_INT; i = v->num_long; return true;
+        case NODE_NUM_DBL: kind = NUMBER_DBL; d = v->num_dbl; return true;
+        default: return false;
+        }
+    }
+    unsigned int hash() const {
+        switch (kind) {
+        case NUMBER_INT: return hashStr((const char*)&i, sizeof(i));
+        case NUMBER_DBL: return hashStr((const char*)&d, sizeof(d));
+        default: return hashStr(s);
+        }
+    }
+    bool operator==(const FieldKey& o) const {
+        switch (kind != o.kind ? -1 : kind) {
+        case NUMBER_INT: return i == o.i;
+        case NUMBER_DBL: return memcmp(&d, &o.d, sizeof(d)) == 0; // -0 is not 0, as in the text
+        case NUMBER_NONE: return s == o.s;
+        default: return false;
+        }
+    }
+};
+
+// What parsing a document took, see Yaml::stats(). Only recorded when SS_YAML_STATS is defined.
+struct ParseStats {
+    static const int SIZE_BUCKETS = 20; // bucket 0 is empty, b is sizes in [2^(b-1), 2^b), the last has the rest
+
+    uint64_t bytes = 0;                     // of the buffer that was parsed, lazy values again when they are
+    uint64_t nodes[NODE_LAZY + 1] = {};     // by ENodeType, a map entry is a string key and its value
+    int maxDepth = 0;                       // of containers, the root is 1
+    uint64_t listSizes[SIZE_BUCKETS] = {};
+    uint64_t mapSizes[SIZE_BUCKETS] = {};   // in entries
+    uint64_t strtodCalls = 0;
+    double strtodSeconds = 0;               // in parsing these numbers
+    size_t arenaBytes = 0;                  // taken by the nodes
+    // whether the size hint the grammar gives onListStart(), the size of the previous list, would
+    // have been enough to reserve for the list
+    uint64_t listHintHits = 0;
+    uint64_t listHintMisses = 0;
+
+    static int sizeBucket(int size) {
+        int b = 0;
+        while (size > 0 && b < SIZE_BUCKETS - 1)
+            size >>= 1, ++b;
+        return b;
+    }
+    // a container of `count` children at `depth`, sizeHint is for lists. times -1 takes it back
+    void container(ENodeType type, int count, int depth, int sizeHint, int64_t times = 1) {
+        nodes[type] += times;
+        (type == NODE_MAP ? mapSizes : listSizes)[sizeBucket(count)] += times;
+        maxDepth = max(maxDepth, depth);
+        if (type == NODE_LIST)
+            (count <= sizeHint ? listHintHits : listHintMisses) += times;
+    }
+    void add(const ParseStats& o) {
+        bytes += o.bytes;
+        for (int i = 0; i <= NODE_LAZY; ++i)
+            nodes[i] += o.nodes[i];
+        maxDepth = max(maxDepth, o.maxDepth);
+        for (int i = 0; i < SIZE_BUCKETS; ++i) {
+            listSizes[i] += o.listSizes[i];
+            mapSizes[i] += o.mapSizes[i];
+        }
+        strtodCalls += o.strtodCalls;
+        strtodSeconds += o.strtodSeconds;
+        arenaBytes += o.arenaBytes;
+        listHintHits += o.listHintHits;
+        listHintMisses += o.listHintMisses;
+    }
+#ifdef SS_YAML_STATS
+    static double clock() {
+        return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+#endif
+};
+
+// ---------------------------------------------------------------------------------------------
+// The grammar. It runs over tokens from a lexer without recursion, the open containers are kept
+// in an explicit stack, and reports what it finds to a Handler.
+
+// throws an error about the content at pos of the buffer, with its line number. firstLine is
+// the number of the line buf starts at
+SS_YAML_NORETURN inline void parseError(const char* buf, int pos, const char* what, int firstLine = 1) {
+    int line = firstLine + (int)count(buf, buf + pos, '\n');
+    throw runtime_error("line " + to_string(line) + ": " + what);
+}
+
+struct GrammarFrame {
+    int kind;    // TOK_DASH for a dashed list, TOK_OPEN for an inline list, TOK_COLON for a map
+    int indent;  // column of the - or the keys
+    int count;   // elements of a list so far
+};
+
+// What the grammar needs to continue after it stopped for more input
+struct GrammarState
+{
+    vector<GrammarFrame> stack; // open containers
+    bool closing;       // a value is complete, the next tokens close containers or continue them
+    bool tagged;        // the value had a tag which was skipped
+    int lastListSize;   // size hint for the next list
+    int firstLine;      // for errors, the line the buffer starts at
+    // lines after the end at the indentation of the root would not continue the root, because
+    // the last value is missing and would be on the next line, or because a container at that
+    // indentation is open. The parallel parse can't cut there.
+    bool openAtEnd;
+    SS_YAML_STAT(ParseStats* stats = nullptr;) // where to count the numbers parsed, if anywhere
+
+    void reset() {
+        stack.clear();
+        closing = false;
+        tagged = false;
+        lastListSize = 0;
+        firstLine = 1;
+        openAtEnd = false;
+    }
+};
+
+// whether a container other than the root is open at the indentation of the root
+inline bool rootIndentOpen(const vector<GrammarFrame>& stack)
+{
+    for (size_t i = 1; i < stack.size(); ++i) {
+        if (stack[i].kind == stack[0].kind && stack[i].indent == stack[0].indent)
+            return true;
+    }
+    return false;
+}
+
+// whether t is not indented enough to be the value that f waits for, then the value is missing.
+// A dashed list can be the value of a key at the same column as the key.
+inline bool outdented(const GrammarFrame& f, const Token& t)
+{
+    if (f.kind == TOK_COLON)
+        return t.col < f.indent || (t.col == f.indent && t.kind != TOK_DASH);
+    if (f.kind == TOK_DASH)
+        return t.col <= f.indent;
+    return false;
+}
+
+// Parses [buf, end) from the lexer, from the state st was reset to or stopped at. Returns true when
+// the root value is complete. Returns false when the lexer is not ready(), it needs more input,
+// then it can be called again from the same place with more content. The grammar looks at most
+// two tokens ahead and stops only where it starts to look at a token, so ready() means the
+// current token and the one after it are complete.
+template<typename TLexer, typename THandler>
+bool runGrammar(const char* buf, const char* end, TLexer& lex, THandler& h, GrammarState& st)
+{
+    vector<GrammarFrame>& stack = st.stack;
+    while (true) {
+        if (!st.closing) {
+            // parse a value
+            if (!lex.ready())
+                return false;
+            Token t = lex.peek();
+            if (t.kind != TOK_END && !stack.empty() && outdented(stack.back(), t)) { // the value is missing, it's an empty string
+                st.tagged = false;
+                h.onScalar(Str(buf + t.pos, 0));
+                st.closing = true;
+                continue;
+            }
+            if (t.kind == TOK_SCALAR && buf[t.pos] == '&' && !st.tagged) { // node tag, just ignore the entire tag
+                lex.next();
+                st.tagged = true;
+                continue;
+            }
+            st.tagged = false;
+            if (t.kind == TOK_DASH) { // dashed list, each element starts with '- ' but can also be '-\n' if the list is of lists
+                lex.next();
+                h.onListStart(st.lastListSize);
+                stack.push_back(GrammarFrame{ TOK_DASH, t.col, 1 });
+                continue;
+            }
+            if (t.kind == TOK_OPEN) { // inline list
+                lex.next();
+                h.onListStart(st.lastListSize);
+                if (lex.peek().kind == TOK_CLOSE) { // empty list
+                    lex.next();
+                    h.onEnd();
+                }
+                else {
+                    stack.push_back(GrammarFrame{ TOK_OPEN, t.col, 1 });
+                    continue;
+                }
+            }
+            else if (t.kind == TOK_SCALAR) { // a literal or a map key
+                lex.next();
+                Str s(buf + t.pos, t.len);
+                if (lex.peek().kind == TOK_COLON) { // it's the start of a map
+                    lex.next();
+                    h.onMapStart();
+                    h.onKey(s);
+                    stack.push_back(GrammarFrame{ TOK_COLON, t.col, 0 });
+                    continue;
+                }
+                ENumberKind num = NUMBER_NONE;
+                int64_t i;
+                double d;
+                if (THandler::wantNumbers) {
+#ifdef SS_YAML_STATS
+                    double start = st.stats ? ParseStats::clock() : 0;
+                    num = parseNumber(s, end, i, d);
+                    if (st.stats && num == NUMBER_DBL) {
+                        ++st.stats->strtodCalls;
+                        st.stats->strtodSeconds += ParseStats::clock() - start;
+                    }
+#else
+                    num = parseNumber(s, end, i, d);
+#endif
+                }
+                if (num == NUMBER_INT && THandler::wantIntegers)
+                    h.onInt(i);
+                else if (num == NUMBER_INT)
+                    h.onNumber((double)i);
+                else if (num == NUMBER_DBL)
+                    h.onNumber(d);
+                else
+                    h.onScalar(s);
+            }
+            else { // no value before , ] or the end, it's an empty string
+                h.onScalar(Str(buf + t.pos, 0));
+                st.openAtEnd = (t.kind == TOK_END);
+            }
+            st.closing = true;
+            if (lex.peek().kind == TOK_END && rootIndentOpen(stack))
+                st.openAtEnd = true;
+        }
+
+        // a value is complete, see what comes after it in the open containers
+        while (!stack.empty()) {
+            if (!lex.ready())
+                return false;
+            GrammarFrame& f = stack.back();
+            const Token& n = lex.peek();
+            if (f.kind == TOK_DASH) {
+                if (n.kind == TOK_DASH && n.col == f.indent) { // next element of the same list
+                    lex.next();
+                    ++f.count;
+                    st.closing = false;
+                    break;
+                }
+                st.lastListSize = f.count;
+                stack.pop_back();
+                h.onEnd();
+            }
+            else if (f.kind == TOK_OPEN) {
+                if (n.kind == TOK_COMMA) {
+                    lex.next();
+                    if (lex.peek().kind != TOK_CLOSE) {
+                        ++f.count;
+                        st.closing = false;
+                        break;
+                    }
+                }
+                if (lex.peek().kind != TOK_CLOSE)
+                    parseError(buf, lex.peek().pos, "expected , or ] in list", st.firstLine);
+                lex.next();
+                st.lastListSize = f.count;
+                stack.pop_back();
+                h.onEnd();
+                if (lex.peek().kind == TOK_END && rootIndentOpen(stack))
+                    st.openAtEnd = true;
+            }
+            else {
+                if (n.kind == TOK_SCALAR && n.col == f.indent) { // next key of the same map
+                    Token k = lex.next();
+                    if (lex.peek().kind != TOK_COLON)
+                        parseError(buf, lex.peek().pos, "expected : after map key", st.firstLine);
+                    lex.next();
+                    h.onKey(Str(buf + k.pos, k.len));
+                    st.closing = false;
+                    break;
+                }
+                stack.pop_back();
+                h.onEnd();
+            }
+        }
+        if (stack.empty())
+            return true;
+    }
+}
+
+// Parses a buffer or a file to events of a handler, without building a document. Memory does not
+// depend on the size of the input, only on the nesting depth.
+class EventParser
+{
+public:
+    // buf does not need to be 0 terminated
+    template<typename THandler>
+    void parse(const char* buf, size_t size, THandler& handler)
+    {
+        CHECK(size < INT_MAX);
+        Lexer lex;
+        lex.start(buf, 0, (int)size);
+        m_state.reset();
+        runGrammar(buf, buf + size, lex, handler, m_state);
+        if (lex.peek().kind != TOK_END) // check we consumed everything
+            parseError(buf, lex.peek().pos, "unexpected content");
+    }
+    // maps the file and parses it, the pages are read once in order
+    template<typename THandler>
+    void parseFile(const char* path, THandler& handler)
+    {
+        MappedFile file;
+        file.open(path);
+        parse(file.data(), file.size(), handler);
+    }
+
+private:
+    GrammarState m_state; // kept between parses
+};
+
+// ---------------------------------------------------------------------------------------------
+// Reading a document straight into C++ values, in one pass of the grammar and without nodes.
+
+class ValueBinder;
+// where a value goes, an object and how to write into it
+struct BindTarget {
+    void* p;
+    const ValueBinder* b;
+};
+
+// How document values are written into one C++ type. The defaults refuse everything but an empty
+// scalar, which leaves the value as it is.
+class ValueBinder
+{
+public:
+    virtual ~ValueBinder() {}
+    virtual const char* what() const = 0; // for errors
+    // end is the end of the buffer, for parseNumber()
+    virtual bool scalar(void* /*p*/, const Str& s, const char* /*end*/) const { return s.size == 0; }
+    virtual bool mapStart(void* /*p*/) const { return false; }
+    virtual BindTarget key(void* p, const Str& k, unsigned int hash) const;
+    virtual bool listStart(void* /*p*/, int /*sizeHint*/) const { return false; }
+    virtual BindTarget element(void* p, int index) const; // b is null if there can't be this element
+    virtual bool end(void* /*p*/, int /*count*/) const { return true; } // of a map or list
+};
+
+// takes anything and writes it nowhere, for keys that are not fields
+class SkipBinder : public ValueBinder
+{
+public:
+    const char* what() const { return "skipped"; }
+    bool scalar(void*, const Str&, const char*) const { return true; }
+    bool mapStart(void*) const { return true; }
+    bool listStart(void*, int) const { return true; }
+    static const SkipBinder& get() {
+        static SkipBinder b;
+        return b;
+    }
+};
+
+inline BindTarget ValueBinder::key(void*, const Str&, unsigned int) const {
+    return BindTarget{ nullptr, &SkipBinder::get() };
+}
+inline BindTarget ValueBinder::element(void*, int) const {
+    return BindTarget{ nullptr, &SkipBinder::get() };
+}
+
+template<typename T, typename Enable = void>
+struct BinderOf;
+// the binder of T, there is one for every type
+template<typename T>
+const ValueBinder& binderFor() {
+    static typename BinderOf<T>::type b;
+    return b;
+}
+
+template<typename T>
+class NumberBinder : public ValueBinder
+{
+    static bool inRange(int64_t i) {
+        return (int64_t)numeric_limits<T>::min() <= i && (i < 0 || (uint64_t)i <= (uint64_t)numeric_limits<T>::max());
+    }
+public:
+    const char* what() const { return is_integral<T>::value ? "an integer" : "a number"; }
+    bool scalar(void* p, const Str& s, const char* end) const {
+        if (s.size == 0)
+            return true;
+        int64_t i;
+        double d;
+        ENumberKind kind = parseNumber(s, end, i, d);
+        if (kind == NUMBER_INT && (is_floating_point<T>::value || inRange(i)))
+            *(T*)p = (T)i;
+        else if (kind == NUMBER_DBL && is_floating_point<T>::value)
+            *(T*)p = (T)d;
+        else
+            return false;
+        return true;
+    }
+};
+
+class BoolBinder : public ValueBinder
+{
+public:
+    const char* what() const { return "true or false"; }
+    bool scalar(void* p, const Str& s, const char*) const {
+        if (s == Str("true"))
+            *(bool*)p = true;
+        else if (s == Str("false"))
+            *(bool*)p = false;
+        else
+            return s.size == 0;
+        return true;
+    }
+};
+
+class StringBinder : public ValueBinder
+{
+public:
+    const char* what() const { return "a string"; }
+    bool scalar(void* p, const Str& s, const char*) const {
+        ((string*)p)->assign(s.start, s.size);
+        return true;
+    }
+};
+
+// a vector is cleared by a list and gets its elements, it is reserved by the size hint of the grammar
+template<typename E>
+class VectorBinder : public ValueBinder
+{
+public:
+    const char* what() const { return "a list"; }
+    bool listStart(void* p, int sizeHint) const {
+        vector<E>& v = *(vector<E>*)p;
+        v.clear();
+        v.reserve(sizeHint);
+        return true;
+    }
+    BindTarget element(void* p, int) const {
+        vector<E>& v = *(vector<E>*)p;
+        v.push_back(E());
+        return BindTarget{ &v.back(), &binderFor<E>() };
+    }
+};
+
+// array<E, N> and E[N], the list needs to have N elements
+template<typename E, size_t N>
+class ArrayBinder : public ValueBinder
+{
+public:
+    const char* what() const { return "a list of a fixed size"; }
+    bool listStart(void*, int) const { return true; }
+    BindTarget element(void* p, int index) const {
+        if (index >= (int)N)
+            return BindTarget{ nullptr, nullptr };
+        return BindTarget{ (E*)p + index, &binderFor<E>() };
+    }
+    bool end(void*, int count) const { return count == (int)N; }
+};
+
+// The fields of a struct as SS_YAML_BIND lists them. Keys are found with a perfect hash of the
+// field names. It is made once, the first time the struct is read.
+template<typename T>
+class StructFields
+{
+public:
+    // the fields that ssYamlBind() lists for T, with their offsets in a value initialized T
+    void build() {
+        unique_ptr<T> sample(new T());
+        m_sample = sample.get();
+        ssYamlBind(*this, (T*)nullptr); // found by the namespace of T
+        m_sample = nullptr;
+        makeHash();
+    }
+
+    template<typename M>
+    void operator()(const char* name, M T::* member) {
+        CHECK(m_sample != nullptr);
+        size_t offset = (const char*)&(m_sample->*member) - (const char*)m_sample;
+        for (auto& f : m_fields) {
+            if (f.name == name)
+                FAIL(string("field bound twice: ") + name);
+        }
+        m_fields.push_back(Field{ name, offset, &binderFor<M>() });
+    }
+
+    BindTarget find(void* obj, const Str& key, unsigned int hash) const {
+        int i = m_slots[slot(hash)];
+        if (i != -1 && Str(m_fields[i].name) == key)
+            return BindTarget{ (char*)obj + m_fields[i].offset, m_fields[i].b };
+        return BindTarget{ nullptr, &SkipBinder::get() };
+    }
+
+    // finds a seed that puts every field in its own slot, in a table twice as big as needed and
+    // then bigger
+    void makeHash() {
+        for (m_bits = 1; (1u << m_bits) < m_fields.size() * 2; ++m_bits)
+            ;
+        while (true) {
+            for (m_seed = 1; m_seed < 256; ++m_seed) {
+                m_slots.assign((size_t)1 << m_bits, -1);
+                bool ok = true;
+                for (size_t i = 0; i < m_fields.size() && ok; ++i) {
+                    int& s = m_slots[slot(hashStr(Str(m_fields[i].name)))];
+                    ok = (s == -1);
+                    s = (int)i;
+                }
+                if (ok)
+                    return;
+            }
+            ++m_bits;
+        }
+    }
+
+private:
+    unsigned int slot(unsigned int hash) const {
+        return ((hash ^ m_seed) * 2654435761u) >> (32 - m_bits);
+    }
+
+    struct Field {
+        string name;
+        size_t offset;
+        const ValueBinder* b;
+    };
+    const T* m_sample = nullptr; // while building
+    vector<Field> m_fields;
+    vector<int> m_slots; // index of the field, -1 for none
+    unsigned int m_seed = 0;
+    int m_bits = 1;
+};
+
+// Describes the fields of a struct so that TypedParser can read it from a map. Goes in the
+// namespace of the struct:
+//   SS_YAML_BIND(Item) { field("id", &Item::id); field("weight", &Item::weight); }
+#define SS_YAML_BIND(T) inline void ssYamlBind(ss_yaml::StructFields<T>& field, T*)
+
+template<typename T>
+class StructBinder : public ValueBinder
+{
+public:
+    const char* what() const { return "a map"; }
+    bool mapStart(void*) const { return true; }
+    BindTarget key(void* p, const Str& k, unsigned int hash) const {
+        call_once(m_once, [this]() { m_fields.build(); });
+        return m_fields.find(p, k, hash);
+    }
+private:
+    mutable once_flag m_once;
+    mutable StructFields<T> m_fields;
+};
+
+template<typename T, typename Enable>
+struct BinderOf { typedef StructBinder<T> type; };
+template<typename T>
+struct BinderOf<T, typename enable_if<is_arithmetic<T>::value && !is_same<T, bool>::value>::type> { typedef NumberBinder<T> type; };
+template<> struct BinderOf<bool> { typedef BoolBinder type; };
+template<> struct BinderOf<string> { typedef StringBinder type; };
+template<typename E> struct BinderOf<vector<E>> { typedef VectorBinder<E> type; };
+template<typename E, size_t N> struct BinderOf<array<E, N>> { typedef ArrayBinder<E, N> type; };
+template<typename E, size_t N> struct BinderOf<E[N]> { typedef ArrayBinder<E, N> type; };
+
+// writes the events of the grammar into the targets
+struct BindHandler : public Handler
+{
+    static const bool wantNumbers = false; // the binder of the target parses what it needs
+
+    struct Open {
+        BindTarget t;
+        int count;       // elements, or keys of a map
+        bool isMap;
+        BindTarget value; // of the last key of a map
+    };
+    vector<Open> stack;
+    BindTarget root;
+    const char* buf;
+    const char* end;
+    int pos = 0; // of the last key or scalar, for errors
+
+    void start(const char* _buf, const char* _end, const BindTarget& _root) {
+        buf = _buf;
+        end = _end;
+        root = _root;
+        pos = 0;
+        stack.clear();
+    }
+    // where the next value goes
+    BindTarget next() {
+        if (stack.empty())
+            return root;
+        Open& o = stack.back();
+        if (o.isMap)
+            return o.value;
+        BindTarget t = o.t.b->element(o.t.p, o.count++);
+        if (t.b == nullptr)
+            parseError(buf, pos, (string("too many elements for ") + o.t.b->what()).c_str());
+        return t;
+    }
+    SS_YAML_NORETURN void mismatch(const char* got, const BindTarget& t) {
+        parseError(buf, pos, (string(got) + " where " + t.b->what() + " was expected").c_str());
+    }
+
+    void onMapStart() {
+        BindTarget t = next();
+        if (!t.b->mapStart(t.p))
+            mismatch("a map", t);
+        stack.push_back(Open{ t, 0, true, BindTarget{ nullptr, nullptr } });
+    }
+    void onKey(const Str& s) {
+        pos = (int)(s.start - buf);
+        Open& o = stack.back();
+        o.value = o.t.b->key(o.t.p, s, hashStr(s));
+        ++o.count;
+    }
+    void onListStart(int sizeHint) {
+        BindTarget t = next();
+        if (!t.b->listStart(t.p, sizeHint))
+            mismatch("a list", t);
+        stack.push_back(Open{ t, 0, false, BindTarget{ nullptr, nullptr } });
+    }
+    void onScalar(const Str& s) {
+        pos = (int)(s.start - buf);
+        BindTarget t = next();
+        if (!t.b->scalar(t.p, s, end))
+            mismatch(("'" + s.str() + "'").c_str(), t);
+    }
+    void onEnd() {
+        Open& o = stack.back();
+        if (!o.t.b->end(o.t.p, o.count))
+            parseError(buf, pos, (string("wrong number of elements for ") + o.t.b->what()).c_str());
+        stack.pop_back();
+    }
+};
+
+// Reads documents straight into C++ values, in one pass and without building nodes. A struct is
+// read from a map once its fields are described with SS_YAML_BIND, vector<T>, array<T, N> and T[N]
+// from lists, and numbers, bool and string from scalars. Keys that are not fields are skipped and
+// fields that are not in the document keep their value. A value that does not fit throws with its
+// line.
+class TypedParser
+{
+public:
+    // buf does not need to be 0 terminated
+    template<typename T>
+    void parse(const char* buf, size_t size, T& out)
+    {
+        m_handler.start(buf, buf + size, BindTarget{ &out, &binderFor<T>() });
+        m_parser.parse(buf, size, m_handler);
+    }
+    template<typename T>
+    void parseFile(const char* path, T& out)
+    {
+        MappedFile file;
+        file.open(path);
+        parse(file.data(), file.size(), out);
+    }
+
+private:
+    EventParser m_parser;
+    BindHandler m_handler; // kept between parses
+};
+
+// Lexes the complete lines of a buffer that is still being received
+class StreamLexer
+{
+public:
+    void start(const char* buf) {
+        m_lex.start(buf, 0, 0);
+        m_final = false;
+        m_safe = 0;
+    }
+    const Token& peek() {
+        return m_lex.peek();
+    }
+    Token next() {
+        return m_lex.next();
+    }
+    // whether the current token and the one after it are complete
+    bool ready() {
+        if (m_final)
+            return true;
+        const Token& t = m_lex.peek();
+        if (t.kind == TOK_END)
+            return false;
+        if (t.pos < m_safe) // there's a token on a line after it
+            return true;
+        Lexer ahead = m_lex;
+        ahead.next();
+        return ahead.peek().kind != TOK_END;
+    }
+    // the buffer moved to buf and has complete lines up to end. final when nothing more will come
+    void extend(const char* buf, int end, bool final) {
+        m_lex.extend(buf, end);
+        m_final = final;
+        m_safe = lastTokenLine(buf, end);
+    }
+    void discard(int n) {
+        m_lex.discard(n);
+    }
+
+private:
+    // the start of the last line in [0,end) that has a token, the lines after it are empty or comments
+    static int lastTokenLine(const char* buf, int end) {
+        int lineEnd = end;
+        while (lineEnd > 0) {
+            int lineStart = lineEnd - 1;
+            while (lineStart > 0 && buf[lineStart - 1] != '\n')
+                --lineStart;
+            int i = lineStart;
+            while (i < lineEnd && isWs(buf[i]))
+                ++i;
+            if (i < lineEnd && buf[i] != '#')
+                return lineStart;
+            lineEnd = lineStart;
+        }
+        return 0;
+    }
+
+    Lexer m_lex;
+    bool m_final;
+    int m_safe; // tokens before this have another token after them
+};
+
+// Parses input that arrives in chunks to events of a handler. The grammar keeps its state between
+// chunks and the events of the complete lines of every chunk are reported by feed(). Only what was
+// not parsed yet is kept, so memory depends on the size of the chunks and lines, not of the document.
+// The Str given to the handler is valid only in the call.
+class PushParser
+{
+public:
+    PushParser() {
+        reset();
+    }
+    // start a new document
+    void reset() {
+        m_buf.clear();
+        m_avail = 0;
+        m_done = false;
+        m_lex.start(nullptr);
+        m_state.reset();
+    }
+    template<typename THandler>
+    void feed(const char* data, size_t size, THandler& handler)
+    {
+        CHECK(m_buf.size() + size < INT_MAX);
+        int from = (int)m_buf.size();
+        m_buf.insert(m_buf.end(), data, data + size);
+        // only complete lines are parsed, so a token is never cut
+        int i = (int)m_buf.size();
+        while (i > from && m_buf[i - 1] != '\n')
+            --i;
+        if (i == from)
+            return;
+        m_avail = i;
+        run(handler, false);
+    }
+    // the input ended, reports the last line
+    template<typename THandler>
+    void finish(THandler& handler)
+    {
+        m_avail = (int)m_buf.size();
+        run(handler, true);
+    }
+
+private:
+    template<typename THandler>
+    void run(THandler& handler, bool final)
+    {
+        const char* buf = m_buf.data();
+        m_lex.extend(buf, m_avail, final);
+        if (!m_done)
+            m_done = runGrammar(buf, buf + m_avail, m_lex, handler, m_state);
+        if (m_done && m_lex.peek().kind != TOK_END) // check we consumed everything
+            parseError(buf, m_lex.peek().pos, "unexpected content", m_state.firstLine);
+
+        // drop what was parsed, the current token is the first that is still needed
+        int used = min(m_lex.peek().pos, m_avail);
+        m_state.firstLine += (int)count(buf, buf + used, '\n');
+        m_buf.erase(m_buf.begin(), m_buf.begin() + used);
+        m_avail -= used;
+        m_lex.discard(used);
+    }
+
+    vector<char> m_buf;   // input from the first character that is still needed
+    int m_avail;          // end of the complete lines in m_buf
+    bool m_done;          // the root value is complete
+    StreamLexer m_lex;
+    GrammarState m_state;
+};
+
+// Where a document gets the memory for its nodes. The default uses new and delete.
+class MemoryResource
+{
+public:
+    virtual ~MemoryResource() {}
+    virtual void* allocate(size_t size, size_t align) = 0;
+    virtual void deallocate(void* p, size_t size, size_t align) = 0;
+};
+
+inline MemoryResource* newDeleteResource() {
+    struct NewDelete : public MemoryResource {
+        void* allocate(size_t size, size_t) { return ::operator new(size); }
+        void deallocate(void* p, size_t, size_t) { ::operator delete(p); }
+    };
+    static NewDelete res;
+    return &res;
+}
+
+// A bump allocator for the nodes of a document. It takes blocks from a MemoryResource and only
+// gives them back when it is destroyed. reset() keeps a single block as big as all of them so that
+// parsing another document of the same size does not allocate at all.
+class Arena
+{
+public:
+    explicit Arena(MemoryResource* resource = nullptr) : m_resource(resource ? resource : newDeleteResource()) {}
+    ~Arena() { release(); }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // align is a power of 2 no bigger than that of a double
+    void* allocate(size_t size, size_t align) {
+        if (m_head != nullptr) {
+            size_t p = (m_used + align - 1) & ~(align - 1);
+            if (p + size <= m_head->size) {
+                m_used = p + size;
+                return (char*)(m_head + 1) + p;
+            }
+        }
+        newBlock(max(size, (m_head != nullptr) ? m_head->size * 2 : MIN_BLOCK));
+        m_used = size;
+        return m_head + 1;
+    }
+    void reset() {
+        if (m_head != nullptr && m_head->prev != nullptr) {
+            size_t total = 0;
+            for (Block* b = m_head; b != nullptr; b = b->prev)
+                total += b->size;
+            release();
+            newBlock(total);
+        }
+        m_used = 0;
+    }
+    // bytes taken from the resource
+    size_t size() const {
+        size_t total = 0;
+        for (Block* b = m_head; b != nullptr; b = b->prev)
+            total += sizeof(Block) + b->size;
+        return total;
+    }
+
+private:
+    struct Block {
+        Block* prev;
+        size_t size; // not counting this header
+        double alignment; // of what is after the header
+    };
+    static const size_t MIN_BLOCK = 4096;
+
+    void newBlock(size_t size) {
+        Block* b = (Block*)m_resource->allocate(sizeof(Block) + size, alignof(Block));
+        b->prev = m_head;
+        b->size = size;
+        m_head = b;
+    }
+    void release() {
+        while (m_head != nullptr) {
+            Block* prev = m_head->prev;
+            m_resource->deallocate(m_head, sizeof(Block) + m_head->size, alignof(Block));
+            m_head = prev;
+        }
+    }
+
+    MemoryResource* m_resource;
+    Block* m_head = nullptr;
+    size_t m_used = 0; // in m_head
+};
+
+struct ParseOptions {
+    // build the structural index of the whole buffer first and parse from it. Takes memory
+    // for the index but the scan is branch-free
+    bool structIndex = false;
+    // parse the entries of a big top level dashed list or block map on this many threads,
+    // 0 for the number of cores
+    int threads = 1;
+    // for a top level dashed list or block map, only find where the value of every entry is and
+    // parse it the first time it is accessed. Values are found by their indentation without
+    // lexing them, errors in a value are reported when it is accessed
+    bool lazy = false;
+    // keep only these paths and skip the rest of the document without parsing it, see Projection.
+    // The projection is parsed on one thread and not lazily
+    const Projection* projection = nullptr;
+};
+
+// A tape built by the two passes of the grammar over a range of the buffer. A document has
+// one, a parallel parse builds one for each chunk and stitches them.
+struct Tape
+{
+    const char* buf; // the whole buffer, string nodes refer to it
+    int begin;       // the range that was parsed
+    int end;
+    Arena* arena = nullptr; // where nodes is
+    Node* nodes = nullptr;
+    int nodeCount = 0;
+    // pass 1 counts the children of every container, in the order the containers start
+    // pass 2 reads these counts back in the same order to place the children of each container
+    vector<int> counts;
+    bool openAtEnd;  // see GrammarState
+    int stop;        // where the content ended, before end if there is a 0
+    GrammarState grammar;
+    vector<Token> tokens; // structural index
+    vector<int> sortOrder; // scratch for sortMap
+    vector<Node> sortTmp;
+    SS_YAML_STAT(ParseStats stats;)
+
+    // pass 1, counts the children of all containers and the total number of nodes
+    struct CountBuilder : public Handler
+    {
+        static const bool wantNumbers = false; // only counting
+        struct Open {
+            int countIdx;
+            int count;
+            int perChild;
+            bool numbers; // a list with only scalars that start like numbers so far
+        };
+        Tape& t;
+        vector<Open>& stack;
+        bool dropValue = false; // of an empty key, see ProjectedLexer
+        explicit CountBuilder(Tape& _t) : t(_t), stack(_t.countStack) { stack.clear(); }
+
+        void begin(int perChild) {
+            if (!stack.empty())
+                stack.back().numbers = false;
+            stack.push_back(Open{ (int)t.counts.size(), 0, perChild, perChild == 1 });
+            t.counts.push_back(0);
+        }
+        void value() {
+            if (!stack.empty())
+                ++stack.back().count;
+        }
+        void onListStart(int) { begin(1); }
+        void onMapStart() { begin(2); }
+        void onKey(const Str& s) {
+            dropValue = (s.size == 0);
+        }
+        void onScalar(const Str& s) {
+            if (dropValue) {
+                dropValue = false;
+                return;
+            }
+            if (!stack.empty() && (s.size == 0 || (!isNum(s.start[0]) && s.start[0] != '-' && s.start[0] != '.')))
+                stack.back().numbers = false;
+            value();
+        }
+        void onEnd() {
+            Open& o = stack.back();
+            // a list that may be all numbers gets room to pack them, its count is negative
+            // to tell pass 2
+            bool pack = o.numbers && o.count > 0;
+            t.counts[o.countIdx] = pack ? -o.count : o.count;
+            t.nodeCount += o.count * o.perChild + (pack ? packedSlots(o.count) : 0);
+            stack.pop_back();
+            value();
+        }
+    };
+
+    // pass 2, fills the tape
+    struct FillBuilder : public Handler
+    {
+        static const bool wantIntegers = true;
+        struct Open {
+            int self;  // slot of the container
+            int first; // slot of the first child
+            int count; // children so far, for a map the number of keys
+            bool isMap;
+            bool pack; // a list that has room for packed numbers
+        };
+        Tape& t;
+        vector<Open>& stack;
+        int countIdx = 0;
+        bool dropValue = false; // of an empty key, see ProjectedLexer
+        explicit FillBuilder(Tape& _t) : t(_t), stack(_t.fillStack) { stack.clear(); }
+
+        // the slot of the next value
+        int slot() {
+            if (stack.empty())
+                return 0;
+            Open& o = stack.back();
+            if (o.isMap)
+                return o.first + o.count * 2 - 1; // after the key
+            return o.first + o.count++;
+        }
+        void begin(ENodeType type, int sizeHint) {
+            int s = slot();
+            int count = t.counts[countIdx++];
+            bool pack = count < 0;
+            if (pack)
+                count = -count;
+            SS_YAML_STAT(t.stats.container(type, count, (int)stack.size() + 1, sizeHint));
+            (void)sizeHint; // only for stats
+            int first = t.nodeCount;
+            t.nodeCount += ((type == NODE_MAP) ? count * 2 : count) + (pack ? packedSlots(count) : 0);
+            Node& n = t.nodes[s];
+            n.type = type;
+            n.packed = PACKED_NONE;
+            n.cont.first = first - s;
+            n.cont.count = count;
+            stack.push_back(Open{ s, first, 0, type == NODE_MAP, pack });
+        }
+        void onListStart(int sizeHint) { begin(NODE_LIST, sizeHint); }
+        void onMapStart() { begin(NODE_MAP, 0); }
+        void onKey(const Str& s) {
+            if (s.size == 0) {
+                dropValue = true;
+                return;
+            }
+            SS_YAML_STAT(++t.stats.nodes[NODE_STR]);
+            Open& o = stack.back();
+            Node& n = t.nodes[o.first + o.count * 2];
+            t.setStr(n, s);
+            n.hash = hashStr(s);
+            ++o.count;
+        }
+        void onScalar(const Str& s) {
+            if (dropValue) {
+                dropValue = false;
+                return;
+            }
+            t.setStr(t.nodes[slot()], s);
+            SS_YAML_STAT(++t.stats.nodes[NODE_STR]);
+        }
+        void onNumber(double d) {
+            Node& n = t.nodes[slot()];
+            n.type = NODE_NUM_DBL;
+            n.num_dbl = d;
+            SS_YAML_STAT(++t.stats.nodes[NODE_NUM_DBL]);
+        }
+        void onInt(int64_t i) {
+            Node& n = t.nodes[slot()];
+            if (i >= INT_MIN && i <= INT_MAX) {
+                n.type = NODE_NUM_INT;
+                n.num_int = (int)i;
+            }
+            else {
+                n.type = NODE_NUM_LONG;
+                n.num_long = i;
+            }
+            SS_YAML_STAT(++t.stats.nodes[n.type]);
+        }
+        void onEnd() {
+            Open& o = stack.back();
+            if (o.isMap)
+                t.sortMap(o.first, o.count);
+            else if (o.pack)
+                t.packList(t.nodes[o.self]);
+            stack.pop_back();
+        }
+    };
+
+    // the stacks of the builders, kept so that parsing again does not allocate
+    vector<CountBuilder::Open> countStack;
+    vector<FillBuilder::Open> fillStack;
+
+    // nodes that hold the packed numbers of a list of `count`
+    static int packedSlots(int count) {
+        return (count * 8 + sizeof(Node) - 1) / sizeof(Node);
+    }
+
+    // parses [_begin,_end) of _buf, _begin is at the start of a line
+    void parse(const char* _buf, int _begin, int _end, bool structIndex)
+    {
+        buf = _buf;
+        begin = _begin;
+        end = _end;
+        if (structIndex) {
+            buildStructIndex(buf, begin, end, tokens);
+            IndexedLexer lex(tokens);
+            build(lex);
+        }
+        else {
+            Lexer lex;
+            build(lex);
+        }
+    }
+
+    // parses what the projection keeps of [_begin,_end)
+    void parse(const char* _buf, int _begin, int _end, const Projection& projection)
+    {
+        buf = _buf;
+        begin = _begin;
+        end = _end;
+        ProjectedLexer lex(projection);
+        build(lex);
+    }
+
+    template<typename TLexer>
+    void build(TLexer& lex)
+    {
+        // pass 1: count the nodes
+        counts.clear();
+        nodeCount = 1; // root
+        CountBuilder counter(*this);
+        lex.start(buf, begin, end);
+        grammar.reset();
+        runGrammar(buf, buf + end, lex, counter, grammar);
+        openAtEnd = grammar.openAtEnd;
+        const Token& last = lex.peek();
+        if (last.kind != TOK_END) // check we consumed everything
+            parseError(buf, last.pos, "unexpected content");
+        stop = last.pos;
+
+        // pass 2: fill the nodes
+        allocNodes(nodeCount);
+        int total = nodeCount;
+        nodeCount = 1;
+        FillBuilder filler(*this);
+        lex.start(buf, begin, end);
+        grammar.reset();
+#ifdef SS_YAML_STATS
+        stats = ParseStats();
+        stats.bytes = end - begin;
+        stats.arenaBytes = total * sizeof(Node);
+        grammar.stats = &stats;
+        runGrammar(buf, buf + end, lex, filler, grammar);
+        grammar.stats = nullptr;
+#else
+        runGrammar(buf, buf + end, lex, filler, grammar);
+#endif
+        CHECK(nodeCount == total);
+    }
+
+    void allocNodes(int count) {
+        nodes = (Node*)arena->allocate(count * sizeof(Node), alignof(Node));
+    }
+
+    void setStr(Node& n, const Str& s) {
+        n.type = NODE_STR;
+        n.str.pos = (int)(s.start - buf);
+        n.str.size = s.size;
+    }
+
+    // writes the numbers of a list after its children if they are all numbers, see Node
+    void packList(Node& list) {
+        const Node* c = list.children();
+        int count = list.cont.count;
+        bool ints = true;
+        for (int i = 0; i < count; ++i) {
+            if (c[i].type == NODE_NUM_DBL)
+                ints = false;
+            else if (c[i].type != NODE_NUM_INT && c[i].type != NODE_NUM_LONG)
+                return;
+        }
+        if (ints) {
+            int64_t* out = (int64_t*)list.packedData();
+            for (int i = 0; i < count; ++i)
+                out[i] = (c[i].type == NODE_NUM_INT) ? c[i].num_int : c[i].num_long;
+            list.packed = PACKED_I64;
+        }
+        else {
+            double* out = (double*)list.packedData();
+            for (int i = 0; i < count; ++i)
+                out[i] = (c[i].type == NODE_NUM_DBL) ? c[i].num_dbl : (c[i].type == NODE_NUM_INT) ? c[i].num_int : (double)c[i].num_long;
+            list.packed = PACKED_DBL;
+        }
+    }
+
+    // order the entries of a big map by key hash for Accessor::find
+    void sortMap(int first, int count) {
+        if (count <= MAP_LINEAR_MAX)
+            return;
+        Node* kv = &nodes[first];
+        sortOrder.resize(count);
+        for (int i = 0; i < count; ++i)
+            sortOrder[i] = i;
+        // keys of the same hash stay in document order, without the buffer stable_sort allocates
+        sort(sortOrder.begin(), sortOrder.end(), [kv](int a, int b) { return kv[a * 2].hash < kv[b * 2].hash || (kv[a * 2].hash == kv[b * 2].hash && a < b); });
+        sortTmp.assign(kv, kv + count * 2);
+        for (int i = 0; i < count; ++i) {
+            int src = sortOrder[i] * 2, dst = i * 2;
+            kv[dst] = sortTmp[src];
+            kv[dst + 1] = sortTmp[src + 1];
+            if (kv[dst + 1].type == NODE_MAP || kv[dst + 1].type == NODE_LIST)
+                kv[dst + 1].cont.first += src - dst; // children did not move, the value did
+        }
+    }
+};
+
+// whether the line at lineStart starts a top level entry: '- ' or a key and ':' at column indent
+inline bool isTopLevelEntry(const char* buf, int size, int lineStart, int indent, bool isMap)
+{
+    int p = lineStart + indent - 1; // columns count from the newline before the line
+    if (p >= size)
+        return false;
+    for (int i = lineStart; i < p; ++i) {
+        if (!isSpace(buf[i]))
+            return false;
+    }
+    char c = buf[p];
+    bool dash = (c == '-' && p + 1 < size && isWs(buf[p + 1]));
+    if (!isMap)
+        return dash;
+    if (dash || isWs(c) || c == '#' || c == ':' || c == ',' || c == ']' || c == '[' || c == 0)
+        return false;
+    p = (int)(scanFuncs().literal(buf + p, buf + size) - buf);
+    while (p < size && isSpace(buf[p]))
+        ++p;
+    return p < size && buf[p] == ':';
+}
+
+// Finds where to cut a document whose root is a dashed list or a block map into about `pieces`
+// ranges of whole top level entries. An entry starts where the grammar continues the root: a line
+// with '- ' or a key at the indentation of the root. Returns false if the root is neither.
+// Lines that only look like entries, inside a multi-line inline list for instance, make a
+// chunk fail to parse on its own and the caller falls back to a sequential parse.
+inline bool findTopLevelCuts(const char* buf, int size, int pieces, vector<int>& cuts, bool& isMap)
+{
+    Lexer lex;
+    lex.start(buf, 0, size);
+    Token t = lex.next();
+    if (t.kind == TOK_DASH)
+        isMap = false;
+    else if (t.kind == TOK_SCALAR && lex.peek().kind == TOK_COLON)
+        isMap = true;
+    else
+        return false;
+    // the first entry must start a line for the chunks to start at lines
+    if (t.pos != t.col - 1 && buf[t.pos - t.col] != '\n')
+        return false;
+
+    cuts.clear();
+    cuts.push_back(t.pos - t.col + 1);
+    for (int i = 1; i < pieces; ++i) {
+        int pos = max((int)((int64_t)size * i / pieces), cuts.back() + 1);
+        while (pos < size) {
+            const char* nl = (const char*)memchr(buf + pos, '\n', size - pos);
+            if (nl == nullptr) {
+                pos = size;
+                break;
+            }
+            pos = (int)(nl - buf) + 1;
+            if (isTopLevelEntry(buf, size, pos, t.col, isMap))
+                break;
+        }
+        if (pos >= size)
+            break;
+        cuts.push_back(pos);
+    }
+    cuts.push_back(size);
+    return cuts.size() > 2;
+}
+
+// A snapshot is an image of a parsed document that can be used in place, from a mapped file for
+// instance, without parsing. It is this header followed by the nodes and then the strings the
+// nodes refer to. The nodes are laid out like a tape, the image is only valid for the version and
+// the byte order and Node layout of the machine that wrote it.
+struct SnapshotHeader {
+    char magic[8];       // SNAPSHOT_MAGIC
+    uint32_t version;    // SNAPSHOT_VERSION
+    uint32_t byteOrder;  // 0x01020304 as written
+    uint32_t nodeSize;   // sizeof(Node)
+    uint32_t nodeCount;
+    uint64_t sourceHash; // hash64 of the yaml it was parsed from
+    uint64_t poolSize;   // bytes of strings after the nodes
+};
+const char SNAPSHOT_MAGIC[8] = { 's', 's', '_', 'y', 'a', 'm', 'l', 0 };
+const uint32_t SNAPSHOT_VERSION = 1; // change when Node or the layout of the tape changes
+
+// A parsed document can be read from any number of threads at once. Reading may parse a lazy value
+// or build an index, these are made under a lock and published once, after that the readers find
+// them without locking. Parsing, reset() and setAutoIndex() need the document to not be read.
+class Yaml
+{
+private:
+    const char* m_buf;
+    int m_size;
+
+    const Node* m_root = nullptr;
+    Arena m_arena; // the nodes of m_tape and of the lazy tapes
+    Tape m_tape; // m_tape.nodes[0] is the root
+    unique_ptr<atomic<Tape*>[]> m_lazy; // tapes of lazy nodes by their index, null until parsed
+    vector<unique_ptr<Tape>> m_lazyTapes; // owns the tapes in m_lazy
+    mutex m_lazyMutex; // taken to parse a lazy value
+
+    // index of the elements of a list of maps by the string value of one of their fields
+    struct FieldIndex {
+        struct Slot {
+            const Node* value; // the string or number of the field
+            int elem;          // index of the element, -1 for an empty slot
+        };
+        string name;
+        int lookups = 0;      // under m_indexMutex
+        atomic<int> state{0}; // 1 built, -1 can't be built, 0 not yet. slots don't change once it's not 0
+        vector<Slot> slots;   // open addressing, the size is a power of 2
+        FieldIndex* next = nullptr; // of the same list
+    };
+    // The indexes of a list are found by the list in an open addressing table that is only added to.
+    // A slot gets its indexes before its list so a reader that sees the list sees them. When the
+    // table is half full it is copied to a bigger one, the old one stays since a reader may be in it.
+    struct IndexSlot {
+        atomic<const Node*> list;
+        atomic<FieldIndex*> indexes;
+    };
+    struct IndexTable {
+        unique_ptr<IndexSlot[]> slots;
+        unsigned int mask = 0; // size - 1, the size is a power of 2
+        unsigned int used = 0;
+    };
+    atomic<IndexTable*> m_indexTable{nullptr};
+    vector<unique_ptr<IndexTable>> m_indexTables; // owns the current and the old tables
+    vector<unique_ptr<FieldIndex>> m_indexes;     // owns all FieldIndex
+    mutex m_indexMutex; // taken to add or build an index
+    int m_autoIndex = 16;
+
+    SS_YAML_STAT(ParseStats m_stats;) // lazy values add to it when they are parsed, under m_lazyMutex
+
+    MappedFile m_file;
+    uint64_t m_sourceHash = 0; // of a document that was loaded from a snapshot, 0 if it was parsed
+
+    friend struct Accessor;
+
+public:
+    Yaml() { m_tape.arena = &m_arena; }
+    // the nodes are allocated from `resource`, it needs to outlive this object
+    explicit Yaml(MemoryResource* resource) : m_arena(resource) { m_tape.arena = &m_arena; }
+
+    // reading through the accessor may parse lazy values and build indexes, which does not change
+    // the document
+    Accessor root() const {
+        return Accessor(m_root, const_cast<Yaml*>(this));
+    }
+    // maps the file and parses it in place, the mapping is kept for as long as the document
+    void parseFile(const char* path, const ParseOptions& opt = ParseOptions())
+    {
+        m_file.open(path);
+        parse(m_file.data(), m_file.size(), opt);
+    }
+    void parse(const char* inbuf)
+    {
+        parse(inbuf, strlen(inbuf));
+    }
+    // inbuf does not need to be 0 terminated and needs to stay alive as long as the document is used
+    void parse(const char* inbuf, size_t size, const ParseOptions& opt = ParseOptions())
+    {
+        CHECK(size < INT_MAX);
+        clear();
+        m_buf = inbuf;
+        m_size = (int)size;
+        int threads = (opt.threads == 0) ? (int)thread::hardware_concurrency() : opt.threads;
+        if (opt.projection != nullptr)
+            m_tape.parse(m_buf, 0, m_size, *opt.projection);
+        else if (opt.lazy)
+            parseLazy();
+        else if (threads <= 1 || !parseParallel(threads, opt.structIndex))
+            m_tape.parse(m_buf, 0, m_size, opt.structIndex);
+        m_root = &m_tape.nodes[0];
+        SS_YAML_STAT(m_stats = m_tape.stats);
+    }
+
+    // Writes the document as a snapshot image, see SnapshotHeader. Lazy values are parsed for it.
+    void saveSnapshot(vector<char>& image)
+    {
+        CHECK(m_root != nullptr);
+        // the tree is laid out again, breadth first, so that a lazy or stitched document is one tape
+        // and only the strings that are used are kept
+        vector<Node> nodes(1);
+        string pool;
+        unordered_map<string, int> pooled;
+        vector<pair<const Node*, int>> queue(1, make_pair(m_root, 0));
+        for (size_t qi = 0; qi < queue.size(); ++qi) {
+            const Node* src = Accessor::resolve(queue[qi].first, this);
+            int dst = queue[qi].second;
+            Node n = *src;
+            if (n.type == NODE_STR) {
+                auto it = pooled.insert(make_pair(string(m_buf + n.str.pos, n.str.size), (int)pool.size())).first;
+                if (it->second == (int)pool.size())
+                    pool += it->first;
+                n.str.pos = it->second;
+            }
+            else if (n.type == NODE_MAP || n.type == NODE_LIST) {
+                int count = (n.type == NODE_MAP) ? n.cont.count * 2 : n.cont.count;
+                int first = (int)nodes.size();
+                int packed = (n.packed != PACKED_NONE) ? Tape::packedSlots(n.cont.count) : 0;
+                nodes.resize(first + count + packed);
+                if (packed > 0)
+                    memcpy(&nodes[first + count], src->packedData(), n.cont.count * 8);
+                for (int i = 0; i < count; ++i)
+                    queue.push_back(make_pair(src->children() + i, first + i));
+                n.cont.first = first - dst;
+            }
+            nodes[dst] = n;
+        }
+
+        SnapshotHeader h;
+        memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+        h.version = SNAPSHOT_VERSION;
+        h.byteOrder = 0x01020304;
+        h.nodeSize = sizeof(Node);
+        h.nodeCount = (uint32_t)nodes.size();
+        h.sourceHash = (m_sourceHash != 0) ? m_sourceHash : hash64(m_buf, m_size);
+        h.poolSize = pool.size();
+        size_t nodeBytes = nodes.size() * sizeof(Node);
+        image.resize(sizeof(h) + nodeBytes + pool.size());
+        memcpy(&image[0], &h, sizeof(h));
+        memcpy(&image[sizeof(h)], nodes.data(), nodeBytes);
+        memcpy(&image[sizeof(h) + nodeBytes], pool.data(), pool.size());
+    }
+    void saveSnapshot(const char* path)
+    {
+        vector<char> image;
+        saveSnapshot(image);
+        // written aside and renamed over the old one, which other processes may have mapped
+#ifdef _WIN32
+        string tmp = string(path) + "." + to_string(GetCurrentProcessId());
+#else
+        string tmp = string(path) + "." + to_string(getpid());
+#endif
+        tmp += "." + to_string(hash<thread::id>()(this_thread::get_id())) + ".tmp";
+        {
+            ofstream f(tmp.c_str(), ios::binary);
+            f.write(image.data(), image.size());
+            if (!f.good())
+                FAIL("failed writing " + tmp);
+        }
+#ifdef _WIN32
+        bool moved = MoveFileExA(tmp.c_str(), path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        bool moved = rename(tmp.c_str(), path) == 0;
+#endif
+        if (!moved) {
+            remove(tmp.c_str());
+            FAIL(string("failed writing ") + path);
+        }
+    }
+
+    // Uses a snapshot image in place, it needs to stay alive as long as the document. Returns false
+    // and leaves the document empty if the image is not one this code can use, or if sourceHash
+    // is not 0 and is not the hash64 of the yaml the image was made from.
+    bool loadSnapshot(const char* image, size_t size, uint64_t sourceHash = 0)
+    {
+        clear();
+        SnapshotHeader h;
+        if (size < sizeof(h))
+            return false;
+        memcpy(&h, image, sizeof(h));
+        if (memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0 || h.version != SNAPSHOT_VERSION ||
+            h.byteOrder != 0x01020304 || h.nodeSize != sizeof(Node) || h.nodeCount == 0 ||
+            size != sizeof(h) + (uint64_t)h.nodeCount * sizeof(Node) + h.poolSize || h.poolSize >= INT_MAX)
+            return false;
+        if (sourceHash != 0 && sourceHash != h.sourceHash)
+            return false;
+        CHECK((uintptr_t)image % alignof(Node) == 0);
+        m_root = (const Node*)(image + sizeof(h));
+        m_buf = image + sizeof(h) + h.nodeCount * sizeof(Node);
+        m_size = (int)h.poolSize;
+        m_sourceHash = h.sourceHash;
+        return true;
+    }
+    bool loadSnapshotFile(const char* path, uint64_t sourceHash = 0)
+    {
+        clear();
+        try {
+            m_file.open(path);
+        }
+        catch (const runtime_error&) {
+            return false;
+        }
+        return loadSnapshot(m_file.data(), m_file.size(), sourceHash);
+    }
+    // Loads the snapshot at snapshotPath if it was made from the current content of yamlPath,
+    // otherwise parses yamlPath and writes a new snapshot there for next time.
+    void parseFileCached(const char* yamlPath, const char* snapshotPath, const ParseOptions& opt = ParseOptions())
+    {
+        uint64_t h;
+        {
+            MappedFile source;
+            source.open(yamlPath);
+            h = hash64(source.data(), source.size());
+        }
+        if (loadSnapshotFile(snapshotPath, h))
+            return;
+        parseFile(yamlPath, opt);
+        saveSnapshot(snapshotPath);
+    }
+
+    // drops the document and its file but keeps the memory, parsing a document of about the
+    // same size again does not allocate
+    void reset()
+    {
+        clear();
+        m_file.close();
+    }
+
+    // memory taken by the nodes
+    size_t memorySize() const {
+        return m_arena.size();
+    }
+
+    // What parsing took, all zero unless SS_YAML_STATS is defined. Includes the lazy values that
+    // were parsed so far. A document loaded from a snapshot was not parsed.
+    ParseStats stats() const
+    {
+#ifdef SS_YAML_STATS
+        lock_guard<mutex> lock(const_cast<mutex&>(m_lazyMutex));
+        return m_stats;
+#else
+        return ParseStats();
+#endif
+    }
+
+    // nodeWith() indexes a list by a name after this many lookups with it, 0 to never do it
+    void setAutoIndex(int lookups) {
+        m_autoIndex = lookups;
+    }
+
+private:
+    void clear()
+    {
+        m_root = nullptr;
+        m_sourceHash = 0;
+        m_lazy.reset();
+        m_lazyTapes.clear();
+        SS_YAML_STAT(m_stats = ParseStats());
+        m_indexTable.store(nullptr, memory_order_relaxed);
+        m_indexTables.clear();
+        m_indexes.clear();
+        m_arena.reset();
+    }
+
+    static unsigned int hashPtr(const Node* p) {
+        return (unsigned int)(((uintptr_t)p / sizeof(Node)) * 2654435761u);
+    }
+    // the slot of `list` in `t`, or the empty slot where it would go
+    static IndexSlot& indexSlot(IndexTable* t, const Node* list, memory_order order)
+    {
+        unsigned int p = hashPtr(list) & t->mask;
+        while (true) {
+            const Node* l = t->slots[p].list.load(order);
+            if (l == nullptr || l == list)
+                return t->slots[p];
+            p = (p + 1) & t->mask;
+        }
+    }
+
+    // without locking, null if it was not added yet
+    const FieldIndex* findIndex(const Node* list, const Str& name) const
+    {
+        IndexTable* t = m_indexTable.load(memory_order_acquire);
+        if (t == nullptr)
+            return nullptr;
+        IndexSlot& slot = indexSlot(t, list, memory_order_acquire);
+        if (slot.list.load(memory_order_acquire) != list) // an empty slot can have the indexes of a list being added
+            return nullptr;
+        for (const FieldIndex* fi = slot.indexes.load(memory_order_acquire); fi != nullptr; fi = fi->next) {
+            if (Str(fi->name) == name)
+                return fi;
+        }
+        return nullptr;
+    }
+
+    // under m_indexMutex
+    FieldIndex* addIndex(const Node* list, const Str& name)
+    {
+        IndexTable* t = m_indexTable.load(memory_order_relaxed);
+        if (t != nullptr) {
+            IndexSlot& slot = indexSlot(t, list, memory_order_relaxed);
+            for (FieldIndex* fi = slot.indexes.load(memory_order_relaxed); fi != nullptr; fi = fi->next) {
+                if (Str(fi->name) == name)
+                    return fi;
+            }
+        }
+        if (t == nullptr || (t->used + 1) * 2 > t->mask + 1) {
+            unsigned int size = (t == nullptr) ? 16 : (t->mask + 1) * 2;
+            IndexTable* bigger = new IndexTable;
+            m_indexTables.push_back(unique_ptr<IndexTable>(bigger));
+            bigger->slots.reset(new IndexSlot[size]);
+            bigger->mask = size - 1;
+            for (unsigned int i = 0; i < size; ++i) {
+                bigger->slots[i].list.store(nullptr, memory_order_relaxed);
+                bigger->slots[i].indexes.store(nullptr, memory_order_relaxed);
+            }
+            for (unsigned int i = 0; t != nullptr && i <= t->mask; ++i) {
+                const Node* l = t->slots[i].list.load(memory_order_relaxed);
+                if (l == nullptr)
+                    continue;
+                IndexSlot& to = indexSlot(bigger, l, memory_order_relaxed);
+                to.indexes.store(t->slots[i].indexes.load(memory_order_relaxed), memory_order_relaxed);
+                to.list.store(l, memory_order_relaxed);
+            }
+            bigger->used = (t == nullptr) ? 0 : t->used;
+            m_indexTable.store(bigger, memory_order_release);
+            t = bigger;
+        }
+        FieldIndex* fi = new FieldIndex;
+        m_indexes.push_back(unique_ptr<FieldIndex>(fi));
+        fi->name = name.str();
+        IndexSlot& slot = indexSlot(t, list, memory_order_relaxed);
+        fi->next = slot.indexes.load(memory_order_relaxed);
+        slot.indexes.store(fi, memory_order_release);
+        if (slot.list.load(memory_order_relaxed) == nullptr) {
+            slot.list.store(list, memory_order_release);
+            ++t->used;
+        }
+        return fi;
+    }
+
+    bool buildIndex(const Node* list, FieldIndex& fi)
+    {
+        Accessor a(list, this);
+        Str name(fi.name);
+        int count = list->cont.count;
+        int size = 8;
+        while (size < count * 2)
+            size *= 2;
+        fi.slots.assign(size, FieldIndex::Slot{ nullptr, -1 });
+        for (int i = 0; i < count; ++i) {
+            Accessor e = a[i];
+            const Node* v = (e.node->type == NODE_MAP) ? e.find(name) : nullptr;
+            FieldKey k;
+            if (v == nullptr || !k.set(v, m_buf)) {
+                fi.slots.clear();
+                fi.state.store(-1, memory_order_release);
+                return false;
+            }
+            // an element after one with the same value is further along the probe sequence
+            unsigned int p = k.hash() & (size - 1);
+            while (fi.slots[p].elem != -1)
+                p = (p + 1) & (size - 1);
+            fi.slots[p] = FieldIndex::Slot{ v, i };
+        }
+        fi.state.store(1, memory_order_release);
+        return true;
+    }
+
+    bool buildIndex(const Node* list, const Str& name)
+    {
+        lock_guard<mutex> lock(m_indexMutex);
+        FieldIndex* fi = addIndex(list, name);
+        int state = fi->state.load(memory_order_relaxed);
+        return state == 0 ? buildIndex(list, *fi) : state == 1;
+    }
+
+    const Node* findWith(const Accessor& list, const Str& name, const FieldKey& key)
+    {
+        // the lock is only taken to count lookups until the index is built or found not buildable
+        const FieldIndex* fi = findIndex(list.node, name);
+        int state = (fi == nullptr) ? 0 : fi->state.load(memory_order_acquire);
+        if (state == 0 && m_autoIndex > 0) {
+            lock_guard<mutex> lock(m_indexMutex);
+            FieldIndex* f = addIndex(list.node, name);
+            state = f->state.load(memory_order_relaxed);
+            if (state == 0 && ++f->lookups >= m_autoIndex)
+                state = buildIndex(list.node, *f) ? 1 : -1;
+            fi = f;
+        }
+        if (state != 1)
+            return list.scanWith(name, key);
+        unsigned int mask = (unsigned int)fi->slots.size() - 1;
+        for (unsigned int p = key.hash() & mask; fi->slots[p].elem != -1; p = (p + 1) & mask) {
+            FieldKey k;
+            if (k.set(fi->slots[p].value, m_buf) && k == key)
+                return list.node->children() + fi->slots[p].elem;
+        }
+        return nullptr;
+    }
+
+    // the tape of a lazy node, parsed the first time
+    const Node* materialize(const Node* n)
+    {
+        atomic<Tape*>& slot = m_lazy[n->hash];
+        Tape* sub = slot.load(memory_order_acquire);
+        if (sub == nullptr) {
+            lock_guard<mutex> lock(m_lazyMutex); // also guards m_arena
+            sub = slot.load(memory_order_relaxed);
+            if (sub == nullptr) {
+                unique_ptr<Tape> t(new Tape);
+                t->arena = &m_arena;
+                t->parse(m_buf, n->str.pos, n->str.pos + n->str.size, false);
+                sub = t.get();
+                SS_YAML_STAT(m_stats.add(sub->stats));
+                m_lazyTapes.push_back(move(t));
+                slot.store(sub, memory_order_release);
+            }
+        }
+        return &sub->nodes[0];
+    }
+
+    // the value of an entry is skipped by running the grammar on it without a tree
+    struct SkipHandler : public Handler {
+        static const bool wantNumbers = false;
+    };
+
+    // Parses the root, a dashed list or a block map, with a lazy node for the value of every entry.
+    // A value is not lexed, it ends at the first line that is not indented past its entry, see
+    // blockEnd(). A value that starts on such a line is missing, unless it is a dashed list at the
+    // column of the keys which the grammar nests in the entry. That one and an inline list that
+    // goes on past its lines are found by running the grammar on them.
+    // Other roots are parsed fully.
+    void parseLazy()
+    {
+        Lexer lex;
+        lex.start(m_buf, 0, m_size);
+        Token first = lex.peek();
+        bool isMap = false;
+        if (first.kind == TOK_SCALAR && m_buf[first.pos] != '&') {
+            Lexer ahead = lex;
+            ahead.next();
+            isMap = (ahead.peek().kind == TOK_COLON);
+        }
+        if (first.kind != TOK_DASH && !isMap) {
+            m_tape.parse(m_buf, 0, m_size, false);
+            return;
+        }
+
+        m_tape.buf = m_buf;
+        m_tape.begin = 0;
+        m_tape.end = m_size;
+        vector<Node> entries;
+        SkipHandler handler;
+        GrammarState& st = m_tape.grammar;
+        unsigned int lazyCount = 0;
+        while (true) {
+            int entryPos; // of the : or the -
+            if (isMap) {
+                Token k = lex.next();
+                if (lex.peek().kind != TOK_COLON)
+                    parseError(m_buf, lex.peek().pos, "expected : after map key");
+                entryPos = lex.next().pos;
+                Node key;
+                m_tape.setStr(key, Str(m_buf + k.pos, k.len));
+                key.hash = hashStr(m_buf + k.pos, k.len);
+                entries.push_back(key);
+            }
+            else {
+                entryPos = lex.next().pos; // -
+            }
+            Node value;
+            value.type = NODE_LAZY;
+            value.hash = lazyCount++;
+            value.str.pos = lex.peek().pos;
+            int valueEnd = (int)(lex.scan().blockEnd(m_buf + entryPos, m_buf + m_size, first.col, isMap) - m_buf);
+            if (lex.peek().kind != TOK_END && outdented(GrammarFrame{ isMap ? TOK_COLON : TOK_DASH, first.col, 0 }, lex.peek())) {
+                value.str.size = 0; // the value is missing, it's an empty string
+            }
+            else if (value.str.pos < valueEnd && (lex.peek().kind != TOK_OPEN || bracketsClose(m_buf + value.str.pos, m_buf + valueEnd))) {
+                value.str.size = valueEnd - value.str.pos;
+                lex.start(m_buf, valueEnd, m_size);
+            }
+            else {
+                st.reset();
+                runGrammar(m_buf, m_buf + m_size, lex, handler, st);
+                value.str.size = lex.peek().pos - value.str.pos; // up to the next token, what is after a token can change it
+            }
+            entries.push_back(value);
+
+            const Token& n = lex.peek();
+            if (n.col != first.col || n.kind != first.kind)
+                break;
+        }
+        if (lex.peek().kind != TOK_END) // check we consumed everything
+            parseError(m_buf, lex.peek().pos, "unexpected content");
+        m_lazy.reset(new atomic<Tape*>[lazyCount]);
+        for (unsigned int i = 0; i < lazyCount; ++i)
+            m_lazy[i].store(nullptr, memory_order_relaxed);
+
+        int count = (int)entries.size();
+        m_tape.nodeCount = 1 + count;
+        m_tape.allocNodes(1 + count);
+        Node& root = m_tape.nodes[0];
+        root.type = isMap ? NODE_MAP : NODE_LIST;
+        root.packed = PACKED_NONE;
+        root.cont.first = 1;
+        root.cont.count = isMap ? count / 2 : count;
+        copy(entries.begin(), entries.end(), &m_tape.nodes[1]);
+        if (isMap)
+            m_tape.sortMap(1, count / 2);
+#ifdef SS_YAML_STATS
+        ParseStats& stats = m_tape.stats;
+        stats = ParseStats();
+        stats.bytes = m_size;
+        stats.arenaBytes = (1 + count) * sizeof(Node);
+        stats.container(isMap ? NODE_MAP : NODE_LIST, root.cont.count, 1, 0);
+        stats.nodes[NODE_STR] = count - lazyCount;
+        stats.nodes[NODE_LAZY] = lazyCount;
+#endif
+    }
+
+    static const int MIN_CHUNK_SIZE = 256 * 1024;
+
+    // Parses chunks of top level entries on a few threads, each to its own tape, and stitches
+    // them into m_tape. Returns false if the document is not worth splitting or was not split
+    // correctly, then it is parsed again sequentially which also reports the right error.
+    bool parseParallel(int threads, bool structIndex)
+    {
+        int pieces = min(threads * 4, m_size / MIN_CHUNK_SIZE);
+        vector<int> cuts;
+        bool isMap;
+        if (pieces < 2 || !findTopLevelCuts(m_buf, m_size, pieces, cuts, isMap))
+            return false;
+        int chunkCount = (int)cuts.size() - 1;
+        vector<Tape> chunks(chunkCount);
+        unique_ptr<Arena[]> arenas(new Arena[chunkCount]); // the chunks are only until stitch
+        for (int i = 0; i < chunkCount; ++i)
+            chunks[i].arena = &arenas[i];
+        atomic<int> nextChunk(0);
+        atomic<bool> failed(false);
+        auto work = [&]() {
+            for (int i = nextChunk++; i < chunkCount && !failed; i = nextChunk++) {
+                Tape& c = chunks[i];
+                try {
+                    c.parse(m_buf, cuts[i], cuts[i + 1], structIndex);
+                    if (c.nodes[0].type != (isMap ? NODE_MAP : NODE_LIST) || (c.end != m_size && (c.openAtEnd || c.stop != c.end)))
+                        failed = true;
+                }
+                catch (const exception&) {
+                    failed = true;
+                }
+            }
+        };
+        vector<thread> workers;
+        for (int i = 1; i < min(threads, chunkCount); ++i)
+            workers.push_back(thread(work));
+        work();
+        for (auto& w : workers)
+            w.join();
+        if (failed)
+            return false;
+        stitch(chunks, isMap);
+        return true;
+    }
+
+    // The chunk roots are lists or maps whose children are right after them, at 1, followed by
+    // the rest of the nodes. The stitched tape has the root, then the children of all the chunk
+    // roots and then the rest of every chunk. Only the children of the chunk roots change their
+    // distance to their own children.
+    void stitch(vector<Tape>& chunks, bool isMap)
+    {
+        int perChild = isMap ? 2 : 1;
+        int rootCount = 0, total = 1;
+        for (auto& c : chunks) {
+            rootCount += c.nodes[0].cont.count;
+            total += c.nodeCount - 1;
+        }
+        m_tape.buf = m_buf;
+        m_tape.begin = 0;
+        m_tape.end = m_size;
+        m_tape.allocNodes(total);
+        m_tape.nodeCount = total;
+        Node* out = m_tape.nodes;
+        out[0] = chunks[0].nodes[0];
+        out[0].cont.first = 1;
+        out[0].cont.count = rootCount;
+        out[0].packed = PACKED_NONE; // the numbers of a chunk root are only part of the root
+        int childPos = 1, restPos = 1 + rootCount * perChild;
+        for (auto& c : chunks) {
+            int childCount = c.nodes[0].cont.count * perChild;
+            int restCount = c.nodeCount - 1 - childCount;
+            int childDelta = childPos - 1, restDelta = restPos - (1 + childCount);
+            for (int i = 0; i < childCount; ++i) {
+                Node& n = out[childPos + i];
+                n = c.nodes[1 + i];
+                if (n.type == NODE_MAP || n.type == NODE_LIST)
+                    n.cont.first += restDelta - childDelta;
+            }
+            memcpy(out + restPos, c.nodes + 1 + childCount, restCount * sizeof(Node));
+            childPos += childCount;
+            restPos += restCount;
+        }
+        if (isMap)
+            m_tape.sortMap(1, rootCount);
+#ifdef SS_YAML_STATS
+        // the chunk roots are one root now
+        ENodeType rootType = isMap ? NODE_MAP : NODE_LIST;
+        ParseStats& stats = m_tape.stats;
+        stats = ParseStats();
+        for (auto& c : chunks) {
+            stats.add(c.stats);
+            stats.container(rootType, c.nodes[0].cont.count, 1, 0, -1);
+        }
+        stats.container(rootType, rootCount, 1, 0);
+        stats.arenaBytes = total * sizeof(Node);
+#endif
+    }
+};
+
+inline const Node* Accessor::resolve(const Node* node, Yaml* owner) {
+    if (node == nullptr || node->type != NODE_LAZY)
+        return node;
+    return owner->materialize(node);
+}
+
+inline const Node* Accessor::scanWith(const Str& name, const FieldKey& key) const {
+    expect(NODE_LIST, "nodeWith");
+    const Node* v = node->children();
+    for (int i = 0; i < node->cont.count; ++i) {
+        Accessor f = Accessor(v + i, owner).get(name);
+        FieldKey k;
+        if (!k.set(f.node, owner_buf()))
+            f.typeError("nodeWith()");
+        if (k == key)
+            return v + i;
+    }
+    return nullptr;
+}
+inline Accessor Accessor::tryNodeWith(const string& name, const string& key) const {
+    expect(NODE_LIST, "nodeWith");
+    return Accessor(owner->findWith(*this, Str(name), FieldKey(Str(key))), owner);
+}
+inline bool Accessor::buildIndex(const string& name) const {
+    expect(NODE_LIST, "buildIndex");
+    return owner->buildIndex(node, Str(name));
+}
+
+inline void convertPacked(const double* in, float* out, int n) {
+    scanFuncs().toFloats(in, out, n);
+}
+inline void convertPacked(const double* in, double* out, int n) {
+    memcpy(out, in, n * sizeof(double));
+}
+template<typename T, typename P>
+void convertPacked(const P* in, T* out, int n) {
+    for (int i = 0; i < n; ++i)
+        out[i] = (T)in[i];
+}
+
+template<typename T>
+void Accessor::copyTo(T* out, int n) const {
+    expect(NODE_LIST, "copyTo()");
+    CHECK(n >= 0 && n <= node->cont.count);
+    if (node->packed == PACKED_DBL) {
+        convertPacked((const double*)node->packedData(), out, n);
+    }
+    else if (node->packed == PACKED_I64) {
+        convertPacked((const int64_t*)node->packedData(), out, n);
+    }
+    else {
+        for (int i = 0; i < n; ++i)
+            out[i] = (T)Accessor(node->children() + i, owner).dbl();
+    }
+}
+
+template<typename T>
+void Accessor::copyRowMajor(T* out, int rows, int cols) const {
+    expect(NODE_LIST, "copyRowMajor()");
+    int count = node->cont.count;
+    const Node* c = node->children();
+    if (count == rows * cols && (count == 0 || Accessor(c, owner).node->type != NODE_LIST)) {
+        copyTo(out, count);
+        return;
+    }
+    bool ok = (count == rows);
+    for (int i = 0; i < count && ok; ++i) {
+        const Node* row = Accessor(c + i, owner).node;
+        ok = (row->type == NODE_LIST && row->cont.count == cols);
+    }
+    if (!ok)
+        FAIL("copyRowMajor() of " + to_string(rows) + "x" + to_string(cols) + " from a list that is not that shape");
+    for (int i = 0; i < rows; ++i)
+        Accessor(c + i, owner).copyTo(out + i * cols, cols);
+}
+
+template<> struct AsTraits<double> { static double read(const Accessor& a) { return a.dbl(); } };
+template<> struct AsTraits<float> { static float read(const Accessor& a) { return (float)a.dbl(); } };
+template<> struct AsTraits<int64_t> { static int64_t read(const Accessor& a) { return a.i64(); } };
+template<> struct AsTraits<int> { static int read(const Accessor& a) { return a.i32(); } };
+template<> struct AsTraits<string> { static string read(const Accessor& a) { return a.str(); } };
+// a flat list of N numbers, or a list of rows whose lengths multiply to N
+template<typename T, size_t N>
+struct AsTraits<array<T, N>> {
+    static array<T, N> read(const Accessor& a) {
+        array<T, N> ret;
+        int rows = a.len();
+        if (rows > 0 && (int)N % rows == 0 && a[0].node->type == NODE_LIST)
+            a.copyRowMajor(ret.data(), rows, (int)N / rows);
+        else
+            a.copyRowMajor(ret.data(), 1, (int)N);
+        return ret;
+    }
+};
+
+inline const char* Accessor::owner_buf() const {
+    return owner->m_buf;
+}
+
+
+// A query compiled once and evaluated on many documents, or many times on one. Steps are separated
+// by dots or are in brackets:
+//   key    the value of a map by key, the hash of the key is computed once
+//   [n]    element n of a list
+//   [*]    every element of a list
+//   *      every value of a map, in the order of the map
+// so "objects[*].data.model_data.height" is the height of every object. A step that does not fit
+// the node, a missing key or an index out of range, has no match. A key can't have . or [ in it.
+class Path
+{
+public:
+    explicit Path(const string& text) : m_text(text)
+    {
+        size_t p = 0, n = text.size();
+        while (p < n) {
+            Step s;
+            if (text[p] == '[') {
+                size_t close = text.find(']', p);
+                if (close == string::npos)
+                    FAIL("missing ] in path " + text);
+                string in = text.substr(p + 1, close - p - 1);
+                if (in == "*") {
+                    s.kind = STEP_ELEMENTS;
+                }
+                else {
+                    if (in.empty() || in.size() > 9 || in.find_first_not_of("0123456789") != string::npos)
+                        FAIL("bad index [" + in + "] in path " + text);
+                    s.kind = STEP_INDEX;
+                    s.index = atoi(in.c_str());
+                }
+                p = close + 1;
+            }
+            else {
+                if (!m_steps.empty()) {
+                    if (text[p] != '.')
+                        FAIL("expected . in path " + text);
+                    ++p;
+                }
+                size_t e = min(text.find_first_of(".[", p), n);
+                s.key = text.substr(p, e - p);
+                if (s.key.empty())
+                    FAIL("empty key in path " + text);
+                s.kind = (s.key == "*") ? STEP_VALUES : STEP_KEY;
+                s.hash = hashStr(Str(s.key));
+                p = e;
+            }
+            m_steps.push_back(s);
+        }
+    }
+
+    const string& text() const { return m_text; }
+
+    // Writes the matches under `from` to out, up to `capacity` of them, and returns how many there
+    // are in all, which can be more than capacity
+    int find(const Accessor& from, Accessor* out, int capacity) const
+    {
+        int found = 0;
+        walk(from.node, from.owner, 0, [&](const Node* n) {
+            if (found < capacity)
+                out[found] = Accessor(n, from.owner);
+            ++found;
+        });
+        return found;
+    }
+    // same as find() with every match read as<T>(), which throws if one isn't a T
+    template<typename T>
+    int read(const Accessor& from, T* out, int capacity) const
+    {
+        int found = 0;
+        walk(from.node, from.owner, 0, [&](const Node* n) {
+            if (found < capacity)
+                out[found] = Accessor(n, from.owner).as<T>();
+            ++found;
+        });
+        return found;
+    }
+    // the first match, a null accessor if there isn't one
+    Accessor first(const Accessor& from) const
+    {
+        Accessor out(nullptr, from.owner);
+        find(from, &out, 1);
+        return out;
+    }
+
+private:
+    enum EStep {
+        STEP_KEY,
+        STEP_INDEX,
+        STEP_ELEMENTS,
+        STEP_VALUES,
+    };
+    struct Step {
+        EStep kind = STEP_KEY;
+        string key;
+        unsigned int hash = 0;
+        int index = 0;
+    };
+
+    template<typename F>
+    void walk(const Node* n, Yaml* owner, size_t i, const F& emit) const
+    {
+        n = Accessor::resolve(n, owner);
+        if (n == nullptr)
+            return;
+        if (i == m_steps.size()) {
+            emit(n);
+            return;
+        }
+        const Step& s = m_steps[i];
+        if (n->type == NODE_MAP && s.kind == STEP_KEY) {
+            const Node* v = Accessor(n, owner).find(Str(s.key), s.hash);
+            if (v != nullptr)
+                walk(v, owner, i + 1, emit);
+        }
+        else if (n->type == NODE_MAP && s.kind == STEP_VALUES) {
+            for (int c = 0; c < n->cont.count; ++c)
+                walk(n->children() + c * 2 + 1, owner, i + 1, emit);
+        }
+        else if (n->type == NODE_LIST && s.kind == STEP_INDEX) {
+            if (s.index < n->cont.count)
+                walk(n->children() + s.index, owner, i + 1, emit);
+        }
+        else if (n->type == NODE_LIST && s.kind == STEP_ELEMENTS) {
+            for (int c = 0; c < n->cont.count; ++c)
+                walk(n->children() + c, owner, i + 1, emit);
+        }
+    }
+
+    string m_text;
+    vector<Step> m_steps;
+};
+
+
+// Parsed documents by the hash of their text, shared between threads. The least recently used
+// are dropped over the budget in bytes, they stay alive while someone still holds them.
+class ParseCache
+{
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t bytes = 0;
+        size_t entries = 0;
+    };
+
+    explicit ParseCache(size_t budget) : m_budget(budget) {}
+    ParseCache(const ParseCache&) = delete;
+    ParseCache& operator=(const ParseCache&) = delete;
+
+    static ParseCache& global() {
+        static ParseCache cache(256 * 1024 * 1024);
+        return cache;
+    }
+
+    // the document for this text, parsed now if it is not in the cache. The text is copied so it
+    // does not need to stay alive. A projection is not the whole document, it is parsed every time
+    // and not kept.
+    shared_ptr<const Yaml> parse(const char* buf, size_t size, const ParseOptions& opt = ParseOptions())
+    {
+        if (opt.projection != nullptr) {
+            auto e = make_shared<Entry>();
+            e->text.assign(buf, size);
+            e->doc.parse(e->text.data(), size, opt);
+            return shared_ptr<const Yaml>(e, &e->doc);
+        }
+        uint64_t h = hash64(buf, size);
+        {
+            lock_guard<mutex> lock(m_mutex);
+            auto it = m_index.find(h);
+            // the text is compared too, a hash collision would otherwise hand out the wrong document
+            if (it != m_index.end() && it->second->entry->text.size() == size && memcmp(it->second->entry->text.data(), buf, size) == 0) {
+                m_lru.splice(m_lru.begin(), m_lru, it->second);
+                ++m_stats.hits;
+                return shared_ptr<const Yaml>(it->second->entry, &it->second->entry->doc);
+            }
+            ++m_stats.misses;
+        }
+
+        // parsed outside the lock, two threads that miss on the same text both parse it
+        auto e = make_shared<Entry>();
+        e->text.assign(buf, size);
+        e->doc.parse(e->text.data(), size, opt);
+        size_t bytes = size + e->doc.memorySize();
+        shared_ptr<const Yaml> doc(e, &e->doc);
+
+        lock_guard<mutex> lock(m_mutex);
+        if (bytes > m_budget || m_index.count(h) != 0)
+            return doc;
+        m_lru.push_front(Item{ h, bytes, e });
+        m_index[h] = m_lru.begin();
+        m_stats.bytes += bytes;
+        ++m_stats.entries;
+        while (m_stats.bytes > m_budget) {
+            const Item& last = m_lru.back();
+            m_stats.bytes -= last.bytes;
+            --m_stats.entries;
+            ++m_stats.evictions;
+            m_index.erase(last.hash);
+            m_lru.pop_back();
+        }
+        return doc;
+    }
+    shared_ptr<const Yaml> parse(const string& text, const ParseOptions& opt = ParseOptions()) {
+        return parse(text.data(), text.size(), opt);
+    }
+
+    Stats stats() {
+        lock_guard<mutex> lock(m_mutex);
+        return m_stats;
+    }
+    void clear() {
+        lock_guard<mutex> lock(m_mutex);
+        m_lru.clear();
+        m_index.clear();
+        m_stats.bytes = 0;
+        m_stats.entries = 0;
+    }
+
+private:
+    struct Entry {
+        string text;
+        Yaml doc;
+    };
+    struct Item {
+        uint64_t hash;
+        size_t bytes;
+        shared_ptr<Entry> entry;
+    };
+    size_t m_budget;
+    mutex m_mutex;
+    list<Item> m_lru; // most recently used first
+    unordered_map<uint64_t, list<Item>::iterator> m_index;
+    Stats m_stats;
+};
+
+
+
+
+
+
+
+
+
 }
\ No newline at end of file